@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <numeric>
+
+#include "bvh.h"
+
+using namespace std;
+using namespace glm;
+using namespace ppgso;
+
+// Number of bins used to evaluate split candidates along each axis
+constexpr int BINS = 16;
+// Leaves are not split further when they hold this many primitives or less
+constexpr uint32_t LEAF_SIZE = 2;
+
+BVH::Box BVH::Box::bounds(const dvec3 &min, const dvec3 &max) {
+  Box box;
+  for (int i = 0; i < 3; i++) {
+    // Conversion rounds to nearest, nudge the float bounds outwards when they ended up inside
+    box.min[i] = (float) min[i];
+    if (box.min[i] > min[i]) box.min[i] = nextafter(box.min[i], -numeric_limits<float>::max());
+    box.max[i] = (float) max[i];
+    if (box.max[i] < max[i]) box.max[i] = nextafter(box.max[i], numeric_limits<float>::max());
+  }
+  return box;
+}
+
+void BVH::Box::extend(const Box &box) {
+  min = glm::min(min, box.min);
+  max = glm::max(max, box.max);
+}
+
+void BVH::Box::extend(const vec3 &point) {
+  min = glm::min(min, point);
+  max = glm::max(max, point);
+}
+
+float BVH::Box::area() const {
+  auto size = max - min;
+  return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+vec3 BVH::Box::center() const {
+  return (min + max) * 0.5f;
+}
+
+void BVH::build(const vector<Box> &boxes) {
+  nodes.clear();
+  indices.resize(boxes.size());
+  iota(indices.begin(), indices.end(), 0);
+  if (boxes.empty()) return;
+
+  vector<vec3> centers(boxes.size());
+  for (size_t i = 0; i < boxes.size(); i++)
+    centers[i] = boxes[i].center();
+
+  // Root starts as a leaf containing all primitives
+  nodes.reserve(boxes.size() * 2);
+  nodes.push_back({{}, 0, {}, (uint32_t) boxes.size()});
+  split(0, boxes, centers, 0);
+}
+
+void BVH::refit(const vector<Box> &boxes) {
+  // Children are always stored after their parent, walking backwards updates them first
+  for (auto i = nodes.size(); i-- > 0;) {
+    auto &node = nodes[i];
+    Box bounds;
+    if (node.count > 0) {
+      for (auto j = node.offset; j < node.offset + node.count; j++)
+        bounds.extend(boxes[indices[j]]);
+    } else {
+      bounds.extend(Box{nodes[i + 1].min, nodes[i + 1].max});
+      bounds.extend(Box{nodes[node.offset].min, nodes[node.offset].max});
+    }
+    node.min = bounds.min;
+    node.max = bounds.max;
+  }
+}
+
+float BVH::cost() const {
+  if (nodes.empty()) return 0;
+
+  // Same costs as in split, a traversal step costs about as much as one primitive test
+  float total = 0;
+  for (auto &node : nodes)
+    total += Box{node.min, node.max}.area() * (node.count > 0 ? node.count : 1);
+  auto root = Box{nodes[0].min, nodes[0].max}.area();
+  return root > 0 ? total / root : total;
+}
+
+void BVH::split(uint32_t node, const vector<Box> &boxes, const vector<vec3> &centers, int depth) {
+  auto offset = nodes[node].offset;
+  auto count = nodes[node].count;
+  auto first = indices.begin() + offset;
+  auto last = first + count;
+
+  // Bounds of the primitives and of their centers
+  Box bounds, centerBounds;
+  for (auto i = first; i != last; ++i) {
+    bounds.extend(boxes[*i]);
+    centerBounds.extend(centers[*i]);
+  }
+  nodes[node].min = bounds.min;
+  nodes[node].max = bounds.max;
+
+  if (count <= LEAF_SIZE || depth >= STACK_SIZE - 1) return;
+
+  // Find the cheapest binned split according to the surface area heuristic
+  float bestCost = numeric_limits<float>::max();
+  int bestAxis = -1, bestBin = 0;
+  auto extent = centerBounds.max - centerBounds.min;
+  for (int axis = 0; axis < 3; axis++) {
+    if (extent[axis] <= 0) continue;
+
+    struct {
+      Box box;
+      uint32_t count = 0;
+    } bins[BINS];
+
+    float scale = BINS / extent[axis];
+    for (auto i = first; i != last; ++i) {
+      auto bin = std::min(BINS - 1, (int) ((centers[*i][axis] - centerBounds.min[axis]) * scale));
+      bins[bin].box.extend(boxes[*i]);
+      bins[bin].count++;
+    }
+
+    // Sweep from the right to get costs of the right side for each split plane
+    float rightArea[BINS];
+    uint32_t rightCount[BINS];
+    Box right;
+    uint32_t rightSum = 0;
+    for (int bin = BINS - 1; bin > 0; bin--) {
+      right.extend(bins[bin].box);
+      rightSum += bins[bin].count;
+      rightArea[bin] = right.area();
+      rightCount[bin] = rightSum;
+    }
+
+    // Sweep from the left and evaluate split after each bin
+    Box left;
+    uint32_t leftSum = 0;
+    for (int bin = 0; bin < BINS - 1; bin++) {
+      left.extend(bins[bin].box);
+      leftSum += bins[bin].count;
+      if (leftSum == 0 || rightCount[bin + 1] == 0) continue;
+      float cost = left.area() * leftSum + rightArea[bin + 1] * rightCount[bin + 1];
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestAxis = axis;
+        bestBin = bin;
+      }
+    }
+  }
+
+  // Keep the leaf when splitting does not pay off, traversal step costs about as much as one primitive test
+  float leafCost = bounds.area() * count;
+  if (bestAxis < 0 || bounds.area() + bestCost >= leafCost) return;
+
+  float scale = BINS / extent[bestAxis];
+  auto middle = partition(first, last, [&](uint32_t i) {
+    return std::min(BINS - 1, (int) ((centers[i][bestAxis] - centerBounds.min[bestAxis]) * scale)) <= bestBin;
+  });
+  auto leftCount = (uint32_t) (middle - first);
+
+  // Left child follows the parent directly, the right child is placed after the whole left subtree
+  auto leftNode = (uint32_t) nodes.size();
+  nodes.push_back({{}, offset, {}, leftCount});
+  split(leftNode, boxes, centers, depth + 1);
+
+  auto rightNode = (uint32_t) nodes.size();
+  nodes.push_back({{}, offset + leftCount, {}, count - leftCount});
+  split(rightNode, boxes, centers, depth + 1);
+
+  nodes[node].offset = rightNode;
+  nodes[node].count = 0;
+}
@@ -0,0 +1,364 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace ppgso {
+
+  /*!
+   * Bounding volume hierarchy over scene primitives described by their axis aligned bounding boxes.
+   * The hierarchy is built using the surface area heuristic and stored as a flat array of 32 byte nodes in depth first order,
+   * the first child of an inner node directly follows its parent so only the second child needs to be referenced.
+   * Traversal uses a short fixed size stack and visits the closer child first.
+   */
+  class BVH {
+  public:
+    /*!
+     * Axis aligned bounding box
+     */
+    struct Box {
+      glm::vec3 min{std::numeric_limits<float>::max()};
+      glm::vec3 max{-std::numeric_limits<float>::max()};
+
+      /*!
+       * Create a box that conservatively contains the double precision bounds, rounding outwards.
+       * @param min Minimum corner
+       * @param max Maximum corner
+       * @return Single precision box
+       */
+      static Box bounds(const glm::dvec3 &min, const glm::dvec3 &max);
+
+      /*!
+       * Grow the box to contain another box
+       * @param box Box to contain
+       */
+      void extend(const Box &box);
+
+      /*!
+       * Grow the box to contain a point
+       * @param point Point to contain
+       */
+      void extend(const glm::vec3 &point);
+
+      /*!
+       * Compute half of the surface area of the box, enough for the surface area heuristic
+       * @return Half surface area
+       */
+      float area() const;
+
+      /*!
+       * Center of the box
+       * @return Point in the middle of the box
+       */
+      glm::vec3 center() const;
+    };
+
+    /*!
+     * Node of the hierarchy, leaf nodes have count > 0
+     */
+    struct Node {
+      glm::vec3 min;
+      // First primitive index for leaf nodes, second child for inner nodes
+      uint32_t offset;
+      glm::vec3 max;
+      // Number of primitives in a leaf node, 0 for inner nodes
+      uint32_t count;
+    };
+
+    /*!
+     * Bundle of N rays traced through the hierarchy together in single precision, each lane holds one ray.
+     * Lanes are stored as separate arrays so loops over them map directly to SSE/AVX registers.
+     */
+    template<int N>
+    struct Packet {
+      float ox[N], oy[N], oz[N];
+      float dx[N], dy[N], dz[N];
+      // Inverted directions for the slab test
+      float ix[N], iy[N], iz[N];
+      // Maximum distance for each lane, lowered by the intersect callback when a closer hit is found
+      float tmax[N];
+
+      /*!
+       * Set ray of a single lane
+       * @param lane Lane to set
+       * @param origin Ray origin
+       * @param direction Ray direction
+       * @param distance Maximum distance along the ray
+       */
+      void set(int lane, const glm::vec3 &origin, const glm::vec3 &direction, float distance) {
+        ox[lane] = origin.x; oy[lane] = origin.y; oz[lane] = origin.z;
+        dx[lane] = direction.x; dy[lane] = direction.y; dz[lane] = direction.z;
+        ix[lane] = 1.0f / direction.x; iy[lane] = 1.0f / direction.y; iz[lane] = 1.0f / direction.z;
+        tmax[lane] = distance;
+      }
+
+      /*!
+       * Largest maximum distance of all lanes
+       * @return Distance beyond which no lane can find a closer hit
+       */
+      float farthest() const {
+        float result = tmax[0];
+        for (int i = 1; i < N; i++) result = std::max(result, tmax[i]);
+        return result;
+      }
+    };
+
+    std::vector<Node> nodes;
+    // Primitive indices referenced by the leaf nodes
+    std::vector<uint32_t> indices;
+
+    /*!
+     * Build the hierarchy for primitives with given bounding boxes
+     * @param boxes Bounding box for each primitive, primitives are referenced by the index into this vector
+     */
+    void build(const std::vector<Box> &boxes);
+
+    /*!
+     * Update the node bounds after primitives moved, keeping the structure of the hierarchy.
+     * Much cheaper than a build, but the quality drops as primitives move away from their original neighbours.
+     * @param boxes Bounding box for each primitive, same primitives as passed to build
+     */
+    void refit(const std::vector<Box> &boxes);
+
+    /*!
+     * Estimate the traversal cost of the hierarchy with the surface area heuristic used by the builder
+     * @return Expected number of node visits and primitive tests for a ray hitting the root box
+     */
+    float cost() const;
+
+    /*!
+     * Find the closest intersection along a ray
+     * @param origin Ray origin
+     * @param direction Ray direction
+     * @param tmax Maximum distance along the ray, updated by the intersect callback when a closer hit is found
+     * @param intersect Callback void(uint32_t primitive, T &tmax) that tests one primitive
+     */
+    template<typename T, glm::precision P, typename Intersect>
+    void closest(const glm::tvec3<T, P> &origin, const glm::tvec3<T, P> &direction, T &tmax, Intersect intersect) const {
+      traverse(origin, direction, tmax, [&](uint32_t index, T &t) {
+        intersect(index, t);
+        return false;
+      });
+    }
+
+    /*!
+     * Check for any intersection along a ray, traversal stops at the first hit
+     * @param origin Ray origin
+     * @param direction Ray direction
+     * @param tmax Maximum distance along the ray
+     * @param intersect Callback bool(uint32_t primitive, T tmax) that returns true when the primitive is hit
+     * @return True if any primitive is hit closer than tmax
+     */
+    template<typename T, glm::precision P, typename Intersect>
+    bool any(const glm::tvec3<T, P> &origin, const glm::tvec3<T, P> &direction, T tmax, Intersect intersect) const {
+      return traverse(origin, direction, tmax, [&](uint32_t index, T &t) {
+        return intersect(index, t);
+      });
+    }
+
+    /*!
+     * Find the closest intersection for all rays of a packet at once.
+     * A node is visited when at least one of the rays hits its box, so rays should be coherent, e.g. primary rays of neighbouring pixels.
+     * @param packet Rays to trace, the maximum distance of each lane is updated by the intersect callback
+     * @param intersect Callback void(uint32_t primitive, Packet<N> &packet) that tests one primitive against all lanes
+     */
+    template<int N, typename Intersect>
+    void closest(Packet<N> &packet, Intersect intersect) const {
+      if (nodes.empty()) return;
+
+      struct Entry {
+        uint32_t node;
+        float distance;
+      } stack[STACK_SIZE];
+      int top = 0;
+
+      uint32_t current = 0;
+      if (std::isinf(slabs(nodes[current], packet))) return;
+
+      while (true) {
+        auto &node = nodes[current];
+
+        if (node.count > 0) {
+          for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+            intersect(indices[i], packet);
+        } else {
+          // Order children by the closest entry distance of any lane
+          uint32_t first = current + 1, second = node.offset;
+          auto tfirst = slabs(nodes[first], packet);
+          auto tsecond = slabs(nodes[second], packet);
+          if (tsecond < tfirst) {
+            std::swap(first, second);
+            std::swap(tfirst, tsecond);
+          }
+
+          if (!std::isinf(tfirst)) {
+            if (!std::isinf(tsecond)) stack[top++] = {second, tsecond};
+            current = first;
+            continue;
+          }
+        }
+
+        // Skip postponed nodes that are farther than the current hit of every lane
+        do {
+          if (top == 0) return;
+          current = stack[--top].node;
+        } while (stack[top].distance > packet.farthest());
+      }
+    }
+
+    /*!
+     * Visit all primitives whose bounding box contains a point
+     * @param point Point to look up
+     * @param visit Callback void(uint32_t primitive) called for each primitive
+     */
+    template<typename Visit>
+    void contains(const glm::vec3 &point, Visit visit) const {
+      if (nodes.empty()) return;
+
+      uint32_t stack[STACK_SIZE];
+      int top = 0;
+      stack[top++] = 0;
+
+      while (top > 0) {
+        auto &node = nodes[stack[--top]];
+        if (glm::any(glm::lessThan(point, node.min)) || glm::any(glm::greaterThan(point, node.max))) continue;
+
+        if (node.count > 0) {
+          for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+            visit(indices[i]);
+        } else {
+          stack[top++] = node.offset;
+          stack[top++] = (uint32_t) (&node - nodes.data()) + 1;
+        }
+      }
+    }
+
+  private:
+    // Maximal depth of the traversal stack, the builder keeps the tree shallower than this
+    static constexpr int STACK_SIZE = 64;
+
+    /*!
+     * Recursively split primitives of a node
+     * @param node Index of the node to split
+     * @param boxes Bounding boxes of all primitives
+     * @param centers Centers of all bounding boxes
+     * @param depth Depth of the node in the tree
+     */
+    void split(uint32_t node, const std::vector<Box> &boxes, const std::vector<glm::vec3> &centers, int depth);
+
+    /*!
+     * Narrow the interval of a ray to a slab between two planes
+     * A ray parallel to the slab with its origin on one of the planes computes 0 * inf = NaN, such slabs do not limit the ray
+     * @param t0 Distance to the first plane
+     * @param t1 Distance to the second plane
+     * @param enter Entry distance to narrow
+     * @param exit Exit distance to narrow
+     */
+    template<typename T>
+    static void clip(T t0, T t1, T &enter, T &exit) {
+      // NaN is the only value not equal to itself
+      bool valid = t0 == t0 && t1 == t1;
+      enter = valid ? std::max(enter, std::min(t0, t1)) : enter;
+      exit = valid ? std::min(exit, std::max(t0, t1)) : exit;
+    }
+
+    /*!
+     * Compute ray to box intersection distance using the slab test
+     * @param node Node with the box to test
+     * @param origin Ray origin
+     * @param inverse Inverted ray direction
+     * @param tmax Maximum distance along the ray
+     * @return Entry distance or infinity when the box is missed
+     */
+    template<typename T, glm::precision P>
+    static T slabs(const Node &node, const glm::tvec3<T, P> &origin, const glm::tvec3<T, P> &inverse, T tmax) {
+      auto t0 = (glm::tvec3<T, P>(node.min) - origin) * inverse;
+      auto t1 = (glm::tvec3<T, P>(node.max) - origin) * inverse;
+      T enter = 0, exit = tmax;
+      clip(t0.x, t1.x, enter, exit);
+      clip(t0.y, t1.y, enter, exit);
+      clip(t0.z, t1.z, enter, exit);
+      return enter <= exit ? enter : std::numeric_limits<T>::infinity();
+    }
+
+    /*!
+     * Slab test of all lanes of a packet against a node box
+     * @param node Node with the box to test
+     * @param packet Rays to test
+     * @return Smallest entry distance of all lanes that hit the box or infinity when all of them miss
+     */
+    template<int N>
+    static float slabs(const Node &node, const Packet<N> &packet) {
+      float result = std::numeric_limits<float>::infinity();
+      #pragma omp simd reduction(min:result)
+      for (int i = 0; i < N; i++) {
+        float x0 = (node.min.x - packet.ox[i]) * packet.ix[i], x1 = (node.max.x - packet.ox[i]) * packet.ix[i];
+        float y0 = (node.min.y - packet.oy[i]) * packet.iy[i], y1 = (node.max.y - packet.oy[i]) * packet.iy[i];
+        float z0 = (node.min.z - packet.oz[i]) * packet.iz[i], z1 = (node.max.z - packet.oz[i]) * packet.iz[i];
+        float enter = 0, exit = packet.tmax[i];
+        clip(x0, x1, enter, exit);
+        clip(y0, y1, enter, exit);
+        clip(z0, z1, enter, exit);
+        result = std::min(result, enter <= exit ? enter : std::numeric_limits<float>::infinity());
+      }
+      return result;
+    }
+
+    /*!
+     * Short stack traversal shared by closest and any hit queries
+     * @return True if the callback requested to stop the traversal
+     */
+    template<typename T, glm::precision P, typename Intersect>
+    bool traverse(const glm::tvec3<T, P> &origin, const glm::tvec3<T, P> &direction, T &tmax, Intersect intersect) const {
+      if (nodes.empty()) return false;
+
+      auto inverse = T(1) / direction;
+
+      // Postponed nodes along with their entry distance
+      struct Entry {
+        uint32_t node;
+        T distance;
+      } stack[STACK_SIZE];
+      int top = 0;
+
+      uint32_t current = 0;
+      if (std::isinf(slabs(nodes[current], origin, inverse, tmax))) return false;
+
+      while (true) {
+        auto &node = nodes[current];
+
+        if (node.count > 0) {
+          // Leaf, test primitives
+          for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+            if (intersect(indices[i], tmax)) return true;
+        } else {
+          // Inner node, visit the closer child first and postpone the other one
+          uint32_t first = current + 1, second = node.offset;
+          auto tfirst = slabs(nodes[first], origin, inverse, tmax);
+          auto tsecond = slabs(nodes[second], origin, inverse, tmax);
+          if (tsecond < tfirst) {
+            std::swap(first, second);
+            std::swap(tfirst, tsecond);
+          }
+
+          if (!std::isinf(tfirst)) {
+            if (!std::isinf(tsecond)) stack[top++] = {second, tsecond};
+            current = first;
+            continue;
+          }
+        }
+
+        // Pop next node that may still be closer than the current hit
+        do {
+          if (top == 0) return false;
+          current = stack[--top].node;
+        } while (stack[top].distance > tmax);
+      }
+    }
+  };
+}
@@ -0,0 +1,233 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Not available on macOS, closed connections terminate the process there
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+#include "channel.h"
+
+using namespace std;
+using namespace ppgso;
+
+namespace {
+  void fail(const string &message) {
+    stringstream msg;
+    msg << message;
+#ifndef _WIN32
+    if (errno) msg << ": " << strerror(errno);
+#endif
+    msg << endl;
+    throw runtime_error(msg.str());
+  }
+}
+
+Channel::Channel(int descriptor, int process) : descriptor{descriptor}, process{process} {}
+
+Channel::Channel(Channel &&other) : descriptor{other.descriptor}, process{other.process} {
+  other.descriptor = -1;
+  other.process = 0;
+}
+
+Channel &Channel::operator=(Channel &&other) {
+  if (this != &other) {
+    close();
+    descriptor = other.descriptor;
+    process = other.process;
+    other.descriptor = -1;
+    other.process = 0;
+  }
+  return *this;
+}
+
+Channel::~Channel() {
+  close();
+}
+
+void Channel::tooLarge(uint64_t size, uint64_t limit) {
+  stringstream msg;
+  msg << "Received " << size << " values where at most " << limit << " were expected!" << endl;
+  throw runtime_error(msg.str());
+}
+
+#ifdef _WIN32
+
+void Channel::close() {}
+
+Channel Channel::fork(const function<int(Channel &)> &) {
+  throw runtime_error("Channels are not supported on this platform!");
+}
+
+Channel Channel::connect(const string &, int) {
+  throw runtime_error("Channels are not supported on this platform!");
+}
+
+vector<Channel> Channel::accept(const string &, int, int) {
+  throw runtime_error("Channels are not supported on this platform!");
+}
+
+size_t Channel::wait(const vector<Channel> &) {
+  throw runtime_error("Channels are not supported on this platform!");
+}
+
+void Channel::write(const void *, size_t) {
+  throw runtime_error("Channels are not supported on this platform!");
+}
+
+void Channel::read(void *, size_t) {
+  throw runtime_error("Channels are not supported on this platform!");
+}
+
+#else
+
+void Channel::close() {
+  if (descriptor >= 0) ::close(descriptor);
+  if (process > 0) waitpid(process, nullptr, 0);
+  descriptor = -1;
+  process = 0;
+}
+
+Channel Channel::fork(const function<int(Channel &)> &child) {
+  int sockets[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) fail("Failed to create socket pair");
+
+  auto pid = ::fork();
+  if (pid < 0) fail("Failed to fork process");
+
+  if (pid == 0) {
+    ::close(sockets[0]);
+    int result = EXIT_FAILURE;
+    try {
+      Channel channel{sockets[1]};
+      result = child(channel);
+    } catch (exception &e) {
+      fprintf(stderr, "%s", e.what());
+    }
+    // Skip destructors and exit handlers inherited from the parent
+    _exit(result);
+  }
+
+  ::close(sockets[1]);
+  return Channel{sockets[0], pid};
+}
+
+Channel Channel::connect(const string &host, int port) {
+  addrinfo hints{}, *addresses;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &addresses) != 0) {
+    stringstream msg;
+    msg << "Failed to resolve " << host << "!" << endl;
+    throw runtime_error(msg.str());
+  }
+
+  int descriptor = -1;
+  for (auto address = addresses; address && descriptor < 0; address = address->ai_next) {
+    descriptor = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (descriptor >= 0 && ::connect(descriptor, address->ai_addr, address->ai_addrlen) != 0) {
+      ::close(descriptor);
+      descriptor = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (descriptor < 0) fail("Failed to connect to " + host + ":" + to_string(port));
+
+  // Messages are small and answered right away, do not wait to merge them
+  int enable = 1;
+  setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+  return Channel{descriptor};
+}
+
+vector<Channel> Channel::accept(const string &host, int port, int count) {
+  addrinfo hints{}, *addresses;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &addresses) != 0) {
+    stringstream msg;
+    msg << "Failed to resolve " << host << "!" << endl;
+    throw runtime_error(msg.str());
+  }
+
+  int enable = 1, listener = -1;
+  for (auto address = addresses; address && listener < 0; address = address->ai_next) {
+    listener = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (listener < 0) continue;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    if (bind(listener, address->ai_addr, address->ai_addrlen) != 0 || listen(listener, count) != 0) {
+      ::close(listener);
+      listener = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (listener < 0) fail("Failed to listen on " + host + ":" + to_string(port));
+
+  vector<Channel> channels;
+  while ((int) channels.size() < count) {
+    int descriptor = ::accept(listener, nullptr, nullptr);
+    if (descriptor < 0) {
+      ::close(listener);
+      fail("Failed to accept connection");
+    }
+    setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    channels.emplace_back(descriptor);
+  }
+  ::close(listener);
+  return channels;
+}
+
+size_t Channel::wait(const vector<Channel> &channels) {
+  vector<pollfd> descriptors;
+  for (auto &channel : channels)
+    descriptors.push_back({channel.descriptor, POLLIN, 0});
+
+  while (true) {
+    if (poll(descriptors.data(), descriptors.size(), -1) < 0) {
+      if (errno == EINTR) continue;
+      fail("Failed to wait for channels");
+    }
+    for (size_t i = 0; i < descriptors.size(); i++)
+      if (descriptors[i].revents) return i;
+  }
+}
+
+void Channel::write(const void *data, size_t size) {
+  auto bytes = (const char *) data;
+  while (size > 0) {
+    // Report closed connections as errors instead of terminating on SIGPIPE
+    auto sent = ::send(descriptor, bytes, size, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) continue;
+    if (sent <= 0) fail("Failed to send data");
+    bytes += sent;
+    size -= sent;
+  }
+}
+
+void Channel::read(void *data, size_t size) {
+  auto bytes = (char *) data;
+  while (size > 0) {
+    auto received = ::recv(descriptor, bytes, size, 0);
+    if (received < 0 && errno == EINTR) continue;
+    if (received == 0) errno = 0;
+    if (received <= 0) fail("Connection closed while receiving data");
+    bytes += received;
+    size -= received;
+  }
+}
+
+#endif
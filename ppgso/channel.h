@@ -0,0 +1,134 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace ppgso {
+
+  /*!
+   * Bidirectional byte stream to another process, used to distribute work between processes or machines.
+   * Channels are created by forking a local process, connecting to a listening process or accepting connections.
+   * Values are sent in their in-memory representation, so both ends need the same architecture.
+   * Only available on POSIX systems, the factory functions throw on other platforms.
+   */
+  class Channel {
+  public:
+    /*!
+     * Take ownership of an open socket
+     * @param descriptor - File descriptor of the socket.
+     * @param process - Id of a forked process to wait for when the channel is closed, 0 for none.
+     */
+    explicit Channel(int descriptor, int process = 0);
+    Channel(Channel &&other);
+    Channel &operator=(Channel &&other);
+    Channel(const Channel &) = delete;
+    Channel &operator=(const Channel &) = delete;
+
+    /*!
+     * Close the channel and wait for the forked process to exit
+     */
+    ~Channel();
+
+    /*!
+     * Fork a process connected to this one
+     * @param child - Function the forked process runs, its result is the exit code of the process.
+     * @return - Channel to the forked process.
+     */
+    static Channel fork(const std::function<int(Channel &)> &child);
+
+    /*!
+     * Connect to a process that accepts connections
+     * @param host - Host name or address.
+     * @param port - TCP port.
+     * @return - Channel to the remote process.
+     */
+    static Channel connect(const std::string &host, int port);
+
+    /*!
+     * Wait for processes to connect
+     * Anyone who can reach the address can connect, callers should verify the peers before trusting them.
+     * @param host - Local address to listen on, "127.0.0.1" accepts only processes of the same machine.
+     * @param port - TCP port to listen on.
+     * @param count - Number of connections to accept.
+     * @return - Channels to the connected processes.
+     */
+    static std::vector<Channel> accept(const std::string &host, int port, int count);
+
+    /*!
+     * Wait until any of the channels has data to receive
+     * @param channels - Channels to watch.
+     * @return - Index of a channel with data.
+     */
+    static size_t wait(const std::vector<Channel> &channels);
+
+    /*!
+     * Send raw data, blocks until all of it is sent
+     * @param data - Pointer to the data.
+     * @param size - Number of bytes to send.
+     */
+    void write(const void *data, size_t size);
+
+    /*!
+     * Receive raw data, blocks until all of it arrives
+     * @param data - Pointer to the buffer to receive to.
+     * @param size - Number of bytes to receive.
+     */
+    void read(void *data, size_t size);
+
+    /*!
+     * Send a value that can be copied as raw memory
+     * @param value - Value to send.
+     */
+    template<typename T>
+    void send(const T &value) {
+      static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be sent");
+      write(&value, sizeof(T));
+    }
+
+    /*!
+     * Send a vector of values that can be copied as raw memory, the size is sent first
+     * @param values - Values to send.
+     */
+    template<typename T>
+    void send(const std::vector<T> &values) {
+      static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be sent");
+      send((uint64_t) values.size());
+      write(values.data(), values.size() * sizeof(T));
+    }
+
+    /*!
+     * Receive a value sent by send
+     * @param value - Value to receive to.
+     */
+    template<typename T>
+    void receive(T &value) {
+      static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be received");
+      read(&value, sizeof(T));
+    }
+
+    /*!
+     * Receive a vector sent by send, throws if the sender announces more values than expected
+     * @param values - Vector to receive to, it is resized to the received size.
+     * @param limit - Maximum number of values accepted.
+     */
+    template<typename T>
+    void receive(std::vector<T> &values, uint64_t limit) {
+      static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be received");
+      uint64_t size;
+      receive(size);
+      if (size > limit) tooLarge(size, limit);
+      values.resize(size);
+      read(values.data(), size * sizeof(T));
+    }
+
+  private:
+    int descriptor;
+    int process;
+
+    void close();
+
+    [[noreturn]] static void tooLarge(uint64_t size, uint64_t limit);
+  };
+}
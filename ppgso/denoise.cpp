@@ -0,0 +1,123 @@
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include "denoise.h"
+#include "scheduler.h"
+
+using namespace std;
+using namespace glm;
+using namespace ppgso;
+
+namespace {
+  // B3 spline kernel of the a-trous transform
+  const float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+
+  float luminance(const vec3 &color) {
+    return dot(color, {0.2126f, 0.7152f, 0.0722f});
+  }
+}
+
+Denoiser::Denoiser(int width, int height, int iterations) : width{width}, height{height}, iterations{iterations} {}
+
+vector<vec3> Denoiser::filter(const Frame &frame, TileScheduler &scheduler) const {
+  auto size = (size_t) width * height;
+  if (frame.color.size() != size || frame.variance.size() != size || frame.albedo.size() != size ||
+      frame.normal.size() != size || frame.depth.size() != size) {
+    stringstream msg;
+    msg << "Denoiser expects buffers of " << width << "x" << height << " pixels!" << endl;
+    throw runtime_error(msg.str());
+  }
+
+  // The tiles of the scheduler need to cover exactly this image
+  size_t covered = 0;
+  bool inside = true;
+  for (auto &tile : scheduler.getTiles()) {
+    inside = inside && tile.x >= 0 && tile.y >= 0 && tile.x + tile.width <= width && tile.y + tile.height <= height;
+    covered += (size_t) tile.width * tile.height;
+  }
+  if (!inside || covered != size) {
+    stringstream msg;
+    msg << "Denoiser expects a scheduler splitting an image of " << width << "x" << height << " pixels!" << endl;
+    throw runtime_error(msg.str());
+  }
+
+  vector<vec3> color = frame.color, nextColor(size);
+  vector<float> variance(size), nextVariance(size);
+
+  // Single pixel variance estimates are noisy themselves, smooth them with a 3x3 gaussian first
+  scheduler.run([&](const Tile &tile, unsigned) {
+    for (int y = tile.y; y < tile.y + tile.height; y++) {
+      for (int x = tile.x; x < tile.x + tile.width; x++) {
+        float sum = 0, weights = 0;
+        for (int dy = -1; dy <= 1; dy++) {
+          for (int dx = -1; dx <= 1; dx++) {
+            int qx = x + dx, qy = y + dy;
+            if (qx < 0 || qy < 0 || qx >= width || qy >= height) continue;
+            float weight = kernel[dx * 2 + 2] * kernel[dy * 2 + 2];
+            sum += weight * frame.variance[qy * width + qx];
+            weights += weight;
+          }
+        }
+        variance[y * width + x] = sum / weights;
+      }
+    }
+  });
+
+  for (int iteration = 0; iteration < iterations; iteration++) {
+    int step = 1 << iteration;
+
+    scheduler.run([&](const Tile &tile, unsigned) {
+      for (int y = tile.y; y < tile.y + tile.height; y++) {
+        for (int x = tile.x; x < tile.x + tile.width; x++) {
+          auto p = (size_t) y * width + x;
+          // Background has nothing to denoise
+          if (frame.depth[p] <= 0) {
+            nextColor[p] = color[p];
+            nextVariance[p] = variance[p];
+            continue;
+          }
+
+          auto lp = luminance(color[p]);
+          auto colorScale = colorSigma * sqrt(variance[p]) + 1e-4f;
+          auto depthScale = depthSigma * frame.depth[p] * step;
+
+          vec3 sum{0, 0, 0};
+          float varianceSum = 0, weights = 0;
+          for (int dy = -2; dy <= 2; dy++) {
+            for (int dx = -2; dx <= 2; dx++) {
+              int qx = x + dx * step, qy = y + dy * step;
+              if (qx < 0 || qy < 0 || qx >= width || qy >= height) continue;
+              auto q = (size_t) qy * width + qx;
+              if (frame.depth[q] <= 0) continue;
+
+              auto albedo = frame.albedo[p] - frame.albedo[q];
+              float weight = kernel[dx + 2] * kernel[dy + 2]
+                             * pow(std::max(0.0f, dot(frame.normal[p], frame.normal[q])), normalSigma)
+                             * exp(-abs(frame.depth[p] - frame.depth[q]) / depthScale
+                                   - dot(albedo, albedo) / albedoSigma
+                                   - abs(lp - luminance(color[q])) / colorScale);
+
+              sum += weight * color[q];
+              varianceSum += weight * weight * variance[q];
+              weights += weight;
+            }
+          }
+
+          // Keep the pixel when even the center has no weight, e.g. for a degenerate normal
+          if (weights <= 0) {
+            nextColor[p] = color[p];
+            nextVariance[p] = variance[p];
+            continue;
+          }
+          nextColor[p] = sum / weights;
+          nextVariance[p] = varianceSum / (weights * weights);
+        }
+      }
+    });
+
+    swap(color, nextColor);
+    swap(variance, nextVariance);
+  }
+  return color;
+}
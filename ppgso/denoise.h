@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace ppgso {
+
+  class TileScheduler;
+
+  /*!
+   * Edge avoiding a-trous wavelet filter for noisy path traced images
+   * (H. Dammertz et al., Edge-Avoiding A-Trous Wavelet Transform for fast Global Illumination Filtering, 2010).
+   * Repeated sparse 5x5 blurs with a doubling step reach wide footprints cheaply, while weights computed from auxiliary
+   * buffers of the first collision keep edges between objects sharp. Color differences are judged against the estimated
+   * noise of each pixel as in SVGF (C. Schied et al., 2017), so pixels that already converged are left mostly untouched.
+   */
+  class Denoiser {
+  public:
+    /*!
+     * Buffers describing a rendered frame, one entry per pixel in row order
+     */
+    struct Frame {
+      // Noisy linear color
+      std::vector<glm::vec3> color;
+      // Variance of the luminance estimate of each pixel
+      std::vector<float> variance;
+      // Diffuse color and normal of the first collision
+      std::vector<glm::vec3> albedo, normal;
+      // Distance to the first collision, 0 where nothing was hit
+      std::vector<float> depth;
+    };
+
+    // Weight of the color difference relative to the noise, larger values blur more
+    float colorSigma = 4.0f;
+    // Exponent of the normal similarity, larger values keep more geometric detail
+    float normalSigma = 128.0f;
+    // Relative depth difference tolerated for each pixel of distance
+    float depthSigma = 0.02f;
+    // Squared albedo difference tolerated between neighbours
+    float albedoSigma = 0.01f;
+
+    /*!
+     * Create denoiser for images of given size
+     * @param width - Width of the image in pixels.
+     * @param height - Height of the image in pixels.
+     * @param iterations - Number of filter passes, the footprint grows to 2^(iterations + 2) pixels.
+     */
+    Denoiser(int width, int height, int iterations = 5);
+
+    /*!
+     * Filter a frame on the threads of a scheduler
+     * @param frame - Buffers of the frame, all of them need width * height entries.
+     * @param scheduler - Scheduler splitting an image of the same size into tiles.
+     * @return - Filtered color.
+     */
+    std::vector<glm::vec3> filter(const Frame &frame, TileScheduler &scheduler) const;
+
+  private:
+    int width, height, iterations;
+  };
+}
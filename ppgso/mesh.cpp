@@ -24,6 +24,15 @@ Mesh::Mesh(const string &obj_file) {
     throw runtime_error(msg.str());
   }
 
+  initGL();
+}
+
+Mesh::Mesh(vector<tinyobj::shape_t> &&shapes, vector<tinyobj::material_t> &&materials)
+    : shapes{std::move(shapes)}, materials{std::move(materials)} {
+  initGL();
+}
+
+void Mesh::initGL() {
   // Initialize OpenGL Buffers
   for(auto& shape : shapes) {
     gl_buffer buffer;
@@ -25,6 +25,8 @@ namespace ppgso {
     std::vector<tinyobj::material_t> materials;
     std::vector<gl_buffer> buffers;
 
+    void initGL();
+
   public:
 
     /*!
@@ -39,6 +41,15 @@ namespace ppgso {
      */
     Mesh(const std::string &obj);
 
+    /*!
+     * Create mesh from geometry that was already loaded using tinyobj::LoadObj.
+     * Only the OpenGL buffers are created, so the parsing can happen elsewhere (see resource::preloadMesh).
+     *
+     * @param shapes - Shapes to upload to the GPU.
+     * @param materials - Materials associated with the shapes.
+     */
+    Mesh(std::vector<tinyobj::shape_t> &&shapes, std::vector<tinyobj::material_t> &&materials);
+
     ~Mesh();
 
     /*!
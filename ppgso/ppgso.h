@@ -10,7 +10,15 @@
 #include "image_bmp.h"
 #include "image_raw.h"
 #include "texture.h"
+#include "resource.h"
 #include "window.h"
+#include "bvh.h"
+#include "scheduler.h"
+#include "sampler.h"
+#include "robust.h"
+#include "denoise.h"
+#include "channel.h"
+#include "scene_file.h"
 
 namespace ppgso {
   /*!
@@ -0,0 +1,111 @@
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <future>
+#include <sstream>
+
+#include "image_bmp.h"
+#include "resource.h"
+
+using namespace std;
+using namespace ppgso;
+
+namespace {
+  // Geometry parsed from an obj file, waiting to be uploaded
+  struct ObjData {
+    vector<tinyobj::shape_t> shapes;
+    vector<tinyobj::material_t> materials;
+  };
+
+  // Resources are only referenced weakly so they are released together with their last user
+  map<string, weak_ptr<Mesh>> meshes;
+  map<string, weak_ptr<Texture>> textures;
+  // Shader programs are keyed by both sources and the sorted defines
+  using ShaderKey = tuple<string, string, vector<string>>;
+  map<ShaderKey, weak_ptr<Shader>> shaders;
+
+  // Background loads that have not been picked up yet
+  map<string, future<ObjData>> pendingMeshes;
+  map<string, future<Image>> pendingTextures;
+
+  ObjData parseObj(const string &obj) {
+    ObjData data;
+    string err = tinyobj::LoadObj(data.shapes, data.materials, obj.c_str());
+
+    if (!err.empty()) {
+      stringstream msg;
+      msg << err << endl << "Failed to load OBJ file " << obj << "!" << endl;
+      throw runtime_error(msg.str());
+    }
+    return data;
+  }
+
+  template<typename Key, typename T, typename Loader>
+  shared_ptr<T> lookup(map<Key, weak_ptr<T>> &cache, const Key &key, Loader load) {
+    auto &entry = cache[key];
+    auto resource = entry.lock();
+    if (!resource) {
+      resource = load();
+      entry = resource;
+    }
+    return resource;
+  }
+}
+
+shared_ptr<Mesh> resource::loadMesh(const string &obj) {
+  return lookup(meshes, obj, [&]() {
+    auto pending = pendingMeshes.find(obj);
+    if (pending == pendingMeshes.end())
+      return make_shared<Mesh>(obj);
+
+    // Finish the preload, the GPU upload has to happen on this thread
+    auto data = pending->second.get();
+    pendingMeshes.erase(pending);
+    return make_shared<Mesh>(move(data.shapes), move(data.materials));
+  });
+}
+
+shared_ptr<Texture> resource::loadTexture(const string &bmp) {
+  return lookup(textures, bmp, [&]() {
+    auto pending = pendingTextures.find(bmp);
+    if (pending == pendingTextures.end())
+      return make_shared<Texture>(image::loadBMP(bmp));
+
+    auto texture = make_shared<Texture>(pending->second.get());
+    pendingTextures.erase(pending);
+    return texture;
+  });
+}
+
+shared_ptr<Shader> resource::loadShader(const string &vertex_shader_code, const string &fragment_shader_code,
+                                        const vector<string> &defines) {
+  // The order of the defines does not change the program
+  auto sorted = defines;
+  sort(sorted.begin(), sorted.end());
+  sorted.erase(unique(sorted.begin(), sorted.end()), sorted.end());
+
+  ShaderKey key{vertex_shader_code, fragment_shader_code, sorted};
+  return lookup(shaders, key, [&]() {
+    return make_shared<Shader>(vertex_shader_code, fragment_shader_code, sorted);
+  });
+}
+
+void resource::preloadMesh(const string &obj) {
+  if (!meshes[obj].expired() || pendingMeshes.count(obj)) return;
+  pendingMeshes[obj] = async(launch::async, parseObj, obj);
+}
+
+void resource::preloadTexture(const string &bmp) {
+  if (!textures[bmp].expired() || pendingTextures.count(bmp)) return;
+  pendingTextures[bmp] = async(launch::async, image::loadBMP, bmp);
+}
+
+void resource::clear() {
+  meshes.clear();
+  textures.clear();
+  shaders.clear();
+
+  // NOTE: Dropping a future returned by std::async waits for the background work to finish
+  pendingMeshes.clear();
+  pendingTextures.clear();
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <string>
+#include <memory>
+
+#include "mesh.h"
+#include "shader.h"
+#include "texture.h"
+
+namespace ppgso {
+namespace resource {
+
+  /*!
+   * Get a mesh loaded from a Wavefront .obj file.
+   * All callers asking for the same file share a single instance, so the file is parsed and uploaded to the GPU once.
+   * The mesh is released when the last shared pointer to it goes away.
+   *
+   * @param obj - File path to the obj file to load.
+   * @return - Shared mesh instance.
+   */
+  std::shared_ptr<Mesh> loadMesh(const std::string &obj);
+
+  /*!
+   * Get a texture loaded from a BMP image.
+   * All callers asking for the same file share a single instance.
+   *
+   * @param bmp - File path to the BMP image to load.
+   * @return - Shared texture instance.
+   */
+  std::shared_ptr<Texture> loadTexture(const std::string &bmp);
+
+  /*!
+   * Get a shader program compiled from the given sources.
+   * Programs are keyed by their sources and the set of defines, so identical programs are compiled and linked only once
+   * while every combination of defines gets its own specialized program.
+   *
+   * @param vertex_shader_code - String containing the source of the vertex shader.
+   * @param fragment_shader_code - String containing the source of the fragment shader.
+   * @param defines - Variant flags to #define in both shaders.
+   * @return - Shared shader instance.
+   */
+  std::shared_ptr<Shader> loadShader(const std::string &vertex_shader_code, const std::string &fragment_shader_code,
+                                     const std::vector<std::string> &defines = {});
+
+  /*!
+   * Start parsing a Wavefront .obj file on a background thread.
+   * A later loadMesh call for the same file will only upload the prepared data to the GPU.
+   *
+   * @param obj - File path to the obj file to preload.
+   */
+  void preloadMesh(const std::string &obj);
+
+  /*!
+   * Start decoding a BMP image on a background thread.
+   * A later loadTexture call for the same file will only upload the prepared image to the GPU.
+   *
+   * @param bmp - File path to the BMP image to preload.
+   */
+  void preloadTexture(const std::string &bmp);
+
+  /*!
+   * Forget all cached resources and pending preloads.
+   * Resources that are still in use stay alive until their last user releases them.
+   */
+  void clear();
+}
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cmath>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+namespace ppgso {
+
+  /*!
+   * Bound of the relative rounding error accumulated by a sequence of floating point operations,
+   * the gamma_n term from M. Pharr et al., Physically Based Rendering, 3rd edition, chapter 3.9.
+   * @param n - Number of operations.
+   * @return - Bound of the relative error, valid for both float and double.
+   */
+  template<typename T>
+  constexpr T roundingError(int n) {
+    return n * (std::numeric_limits<T>::epsilon() / 2) / (1 - n * (std::numeric_limits<T>::epsilon() / 2));
+  }
+
+  /*!
+   * Move the origin of a ray leaving a surface so it can not collide with the surface it starts on.
+   * The point is moved along the normal by its error bound, then rounded away from the surface so rounding of the sum
+   * can not bring it back. Unlike a fixed epsilon this holds in both float and double and for any scale of the scene.
+   * @param point - Collision point on the surface.
+   * @param normal - Normalized surface normal pointing to the side the ray leaves to.
+   * @param error - Bound of the absolute error of each coordinate of the point.
+   * @return - Origin for the ray leaving the surface.
+   */
+  template<typename T, glm::precision P>
+  glm::tvec3<T, P> offsetOrigin(const glm::tvec3<T, P> &point, const glm::tvec3<T, P> &normal, T error) {
+    auto distance = error * (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+    auto offset = normal * distance;
+    auto origin = point + offset;
+    for (int i = 0; i < 3; i++) {
+      if (offset[i] > 0) origin[i] = std::nextafter(origin[i], std::numeric_limits<T>::infinity());
+      else if (offset[i] < 0) origin[i] = std::nextafter(origin[i], -std::numeric_limits<T>::infinity());
+    }
+    return origin;
+  }
+}
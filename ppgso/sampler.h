@@ -0,0 +1,172 @@
+#pragma once
+#include <cstdint>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+namespace ppgso {
+
+  /*!
+   * Small and fast PCG32 random number generator.
+   * Unlike std::rand it has no shared state, so every thread or pixel can own an independent generator.
+   */
+  class Random {
+  public:
+    /*!
+     * Create generator
+     * @param seed - Starting state.
+     * @param stream - Selects one of 2^63 independent sequences.
+     */
+    explicit Random(uint64_t seed = 0x853c49e6748fea9bULL, uint64_t stream = 0xda3e39cb94b95bdbULL)
+        : increment{(stream << 1) | 1} {
+      next();
+      state += seed;
+      next();
+    }
+
+    /*!
+     * Generate next 32 bit random number
+     * @return - Uniformly distributed random number.
+     */
+    uint32_t next() {
+      uint64_t old = state;
+      state = old * 6364136223846793005ULL + increment;
+      auto shifted = (uint32_t) (((old >> 18) ^ old) >> 27);
+      auto rotation = (uint32_t) (old >> 59);
+      return (shifted >> rotation) | (shifted << ((-rotation) & 31));
+    }
+
+    /*!
+     * Generate random number in the <0, 1) interval
+     * @return - Uniformly distributed random number.
+     */
+    double uniform() {
+      return next() / 4294967296.0;
+    }
+
+  private:
+    uint64_t state = 0;
+    uint64_t increment;
+  };
+
+  /*!
+   * Low discrepancy sample generator for Monte Carlo integration.
+   * Every dimension pair of a pixel sample comes from the 2D Sobol sequence with hash based Owen scrambling and index shuffling
+   * (B. Burley, Practical Hash-based Owen Scrambling, 2020). Samples of a pixel are stratified in each pair,
+   * so any power of two number of samples covers the domain evenly, while different pixels and pairs stay uncorrelated.
+   */
+  class Sampler {
+  public:
+    /*!
+     * Start generating dimensions of a single sample
+     * @param pixel - Index of the pixel or any other value that identifies the integral being estimated.
+     * @param index - Index of the sample for the pixel.
+     */
+    explicit Sampler(uint32_t pixel = 0, uint32_t index = 0) : seed{hash(pixel)}, index{index} {}
+
+    /*!
+     * Get next dimension of the sample
+     * @return - Number in the <0, 1) interval.
+     */
+    double next1D() {
+      auto dimensionSeed = hash(seed ^ hash(dimension++));
+      return scramble(reverse(shuffle(dimensionSeed)), hash(dimensionSeed)) / 4294967296.0;
+    }
+
+    /*!
+     * Get next two dimensions of the sample
+     * @return - Point in the <0, 1) square.
+     */
+    glm::dvec2 next2D() {
+      auto dimensionSeed = hash(seed ^ hash(dimension++));
+      auto shuffled = shuffle(dimensionSeed);
+      return glm::dvec2{scramble(reverse(shuffled), hash(dimensionSeed)),
+                        scramble(sobol(shuffled), hash(dimensionSeed + 1))} / 4294967296.0;
+    }
+
+    /*!
+     * Map a point from the unit square to a direction on the hemisphere around a normal, with density proportional to the cosine
+     * @param normal - Normalized direction of the hemisphere axis.
+     * @param point - Point in the <0, 1) square.
+     * @return - Normalized direction.
+     */
+    static glm::dvec3 cosineHemisphere(const glm::dvec3 &normal, const glm::dvec2 &point) {
+      // Project a uniform point on a disk to the hemisphere
+      double radius = sqrt(point.x);
+      double angle = 2.0 * glm::pi<double>() * point.y;
+      return around(normal, {radius * cos(angle), radius * sin(angle), sqrt(glm::max(0.0, 1.0 - point.x))});
+    }
+
+    /*!
+     * Map a point from the unit square to a direction inside a cone with uniform density
+     * The density of the directions is 1 / (2 * PI * (1 - cosMax))
+     * @param axis - Normalized direction of the cone axis.
+     * @param cosMax - Cosine of the angle between the axis and the cone boundary.
+     * @param point - Point in the <0, 1) square.
+     * @return - Normalized direction.
+     */
+    static glm::dvec3 uniformCone(const glm::dvec3 &axis, double cosMax, const glm::dvec2 &point) {
+      double cosTheta = 1.0 - point.x * (1.0 - cosMax);
+      double sinTheta = sqrt(glm::max(0.0, 1.0 - cosTheta * cosTheta));
+      double angle = 2.0 * glm::pi<double>() * point.y;
+      return around(axis, {sinTheta * cos(angle), sinTheta * sin(angle), cosTheta});
+    }
+
+  private:
+    uint32_t seed;
+    uint32_t index;
+    uint32_t dimension = 0;
+
+    // Shuffle sample order differently for each dimension pair so the pairs are not correlated
+    uint32_t shuffle(uint32_t dimensionSeed) const {
+      return scramble(index, dimensionSeed);
+    }
+
+    // Transform a direction given relative to the z axis so it is relative to the axis instead
+    static glm::dvec3 around(const glm::dvec3 &axis, const glm::dvec3 &direction) {
+      // Orthonormal basis around the axis (T. Duff et al., Building an Orthonormal Basis, Revisited, 2017)
+      double sign = axis.z >= 0 ? 1.0 : -1.0;
+      double a = -1.0 / (sign + axis.z);
+      double b = axis.x * axis.y * a;
+      glm::dvec3 tangent{1.0 + sign * axis.x * axis.x * a, sign * b, -sign * axis.x};
+      glm::dvec3 bitangent{b, sign + axis.y * axis.y * a, -axis.y};
+      return tangent * direction.x + bitangent * direction.y + axis * direction.z;
+    }
+
+    static uint32_t hash(uint32_t x) {
+      x ^= x >> 16;
+      x *= 0x7feb352dU;
+      x ^= x >> 15;
+      x *= 0x846ca68bU;
+      x ^= x >> 16;
+      return x;
+    }
+
+    static uint32_t reverse(uint32_t x) {
+      x = ((x >> 1) & 0x55555555U) | ((x & 0x55555555U) << 1);
+      x = ((x >> 2) & 0x33333333U) | ((x & 0x33333333U) << 2);
+      x = ((x >> 4) & 0x0f0f0f0fU) | ((x & 0x0f0f0f0fU) << 4);
+      x = ((x >> 8) & 0x00ff00ffU) | ((x & 0x00ff00ffU) << 8);
+      return (x >> 16) | (x << 16);
+    }
+
+    // Second dimension of the Sobol sequence, the first one is the bit reversed index
+    static uint32_t sobol(uint32_t index) {
+      uint32_t result = 0;
+      for (uint32_t v = 1U << 31; index; index >>= 1, v ^= v >> 1)
+        if (index & 1) result ^= v;
+      return result;
+    }
+
+    // Owen scrambling of the bits of x, implemented as a permutation of the reversed bits
+    static uint32_t scramble(uint32_t x, uint32_t seed) {
+      x = reverse(x);
+      x += seed;
+      x ^= x * 0x6c50b47cU;
+      x ^= x * 0xb82f1e52U;
+      x ^= x * 0xc7afe638U;
+      x ^= x * 0x8d22f6e6U;
+      return reverse(x);
+    }
+  };
+}
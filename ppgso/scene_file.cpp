@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "scene_file.h"
+#include "tiny_obj_loader.h"
+
+using namespace std;
+using namespace glm;
+using namespace ppgso;
+
+namespace {
+  /*!
+   * Interpolate between the keyframes around a frame, the first and last keyframes hold before and after them
+   * @param keys - Keyframes sorted by frame, at least one.
+   * @param frame - Frame to interpolate at.
+   * @param mix - Callback mix(const Key &a, const Key &b, double t) that blends two keyframes.
+   * @return - Interpolated value.
+   */
+  template<typename Key, typename Mix>
+  auto interpolate(const vector<Key> &keys, double frame, Mix mix) -> decltype(mix(keys[0], keys[0], 0.0)) {
+    auto next = upper_bound(keys.begin(), keys.end(), frame, [](double frame, const Key &key) { return frame < key.frame; });
+    if (next == keys.begin()) return mix(keys.front(), keys.front(), 0);
+    if (next == keys.end()) return mix(keys.back(), keys.back(), 0);
+    auto &previous = *(next - 1);
+    return mix(previous, *next, (frame - previous.frame) / (next->frame - previous.frame));
+  }
+
+  /*!
+   * Insert keyframe keeping the keys sorted, replaces a keyframe of the same frame
+   * @param keys - Keyframes sorted by frame.
+   * @param key - Keyframe to insert.
+   */
+  template<typename Key>
+  void insert(vector<Key> &keys, const Key &key) {
+    auto position = lower_bound(keys.begin(), keys.end(), key, [](const Key &a, const Key &b) { return a.frame < b.frame; });
+    if (position != keys.end() && position->frame == key.frame) *position = key;
+    else keys.insert(position, key);
+  }
+}
+
+dvec3 SceneFile::Sphere::centerAt(double frame) const {
+  if (keys.empty()) return center;
+  return interpolate(keys, frame, [](const Key &a, const Key &b, double t) { return mix(a.center, b.center, t); });
+}
+
+dmat4 SceneFile::Instance::transformAt(double frame) const {
+  if (keys.empty()) return transform;
+  return interpolate(keys, frame, [&](const Key &a, const Key &b, double t) {
+    return translate(dmat4{1.0}, mix(a.translation, b.translation, t)) * transform * mat4_cast(slerp(a.rotation, b.rotation, t));
+  });
+}
+
+SceneFile::Camera SceneFile::cameraAt(double frame) const {
+  if (cameraKeys.empty()) return camera;
+  return interpolate(cameraKeys, frame, [](const CameraKey &a, const CameraKey &b, double t) {
+    return Camera{mix(a.camera.position, b.camera.position, t), mix(a.camera.back, b.camera.back, t),
+                  mix(a.camera.up, b.camera.up, t), mix(a.camera.right, b.camera.right, t)};
+  });
+}
+
+SceneFile::SceneFile(const string &path) {
+  ifstream stream{path};
+  if (!stream.is_open()) {
+    stringstream msg;
+    msg << "Could not open scene " << path << "!" << endl;
+    throw runtime_error(msg.str());
+  }
+
+  auto separator = path.find_last_of("/\\");
+  parse(stream, separator == string::npos ? "" : path.substr(0, separator + 1), path);
+}
+
+SceneFile::SceneFile(istream &stream, const string &directory, const string &name) {
+  parse(stream, directory.empty() || directory.back() == '/' ? directory : directory + '/', name);
+}
+
+SceneFile::Geometry SceneFile::loadGeometry(const string &obj) {
+  vector<tinyobj::shape_t> shapes;
+  vector<tinyobj::material_t> materials;
+  string err = tinyobj::LoadObj(shapes, materials, obj.c_str());
+  if (!err.empty()) {
+    stringstream msg;
+    msg << err << endl << "Failed to load OBJ file " << obj << "!" << endl;
+    throw runtime_error(msg.str());
+  }
+
+  Geometry geometry;
+  for (auto &shape : shapes) {
+    auto &positions = shape.mesh.positions;
+    auto &indices = shape.mesh.indices;
+    geometry.vertices.reserve(geometry.vertices.size() + indices.size());
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+      for (size_t j = i; j < i + 3; j++)
+        geometry.vertices.emplace_back(positions[3 * indices[j]], positions[3 * indices[j] + 1], positions[3 * indices[j] + 2]);
+    }
+  }
+  return geometry;
+}
+
+void SceneFile::parse(istream &stream, const string &directory, const string &name) {
+  map<string, uint32_t> materialNames, geometryNames;
+  string text;
+  int number = 0;
+
+  while (getline(stream, text)) {
+    number++;
+    auto fail = [&](const string &problem) {
+      stringstream msg;
+      msg << name << ":" << number << ": " << problem << endl;
+      throw runtime_error(msg.str());
+    };
+    auto value = [&](istringstream &line) {
+      double result;
+      if (!(line >> result)) fail("Expected a number");
+      return result;
+    };
+    auto vector3 = [&](istringstream &line) {
+      auto x = value(line), y = value(line), z = value(line);
+      return dvec3{x, y, z};
+    };
+    auto lookup = [&](const map<string, uint32_t> &names, const string &key, const string &kind) {
+      auto found = names.find(key);
+      if (found == names.end()) fail("Unknown " + kind + " " + key);
+      return found->second;
+    };
+
+    istringstream line{text.substr(0, text.find('#'))};
+    string keyword, key;
+    if (!(line >> keyword)) continue;
+
+    if (keyword == "camera") {
+      while (line >> key) {
+        if (key == "position") camera.position = vector3(line);
+        else if (key == "back") camera.back = vector3(line);
+        else if (key == "up") camera.up = vector3(line);
+        else if (key == "right") camera.right = vector3(line);
+        else fail("Unknown camera property " + key);
+      }
+    } else if (keyword == "material") {
+      string materialName;
+      if (!(line >> materialName)) fail("Expected a material name");
+      Material material;
+      while (line >> key) {
+        if (key == "emission") material.emission = vector3(line);
+        else if (key == "diffuse") material.diffuse = vector3(line);
+        else if (key == "shininess") material.shininess = value(line);
+        else if (key == "reflectivity") material.reflectivity = value(line);
+        else if (key == "transparency") material.transparency = value(line);
+        else if (key == "refraction") material.refractionIndex = value(line);
+        else fail("Unknown material property " + key);
+      }
+      materialNames[materialName] = (uint32_t) materials.size();
+      materials.push_back(material);
+    } else if (keyword == "light") {
+      Light light;
+      light.position = vector3(line);
+      light.color = vector3(line);
+      light.constant = value(line);
+      light.linear = value(line);
+      light.quadratic = value(line);
+      lights.push_back(light);
+    } else if (keyword == "sphere") {
+      if (!(line >> key)) fail("Expected a material name");
+      Sphere sphere;
+      sphere.material = lookup(materialNames, key, "material");
+      sphere.radius = value(line);
+      sphere.center = vector3(line);
+      spheres.push_back(sphere);
+    } else if (keyword == "blob") {
+      if (!(line >> key)) fail("Expected a material name");
+      Blob blob;
+      blob.material = lookup(materialNames, key, "material");
+      blob.radius = value(line);
+      blob.center = vector3(line);
+      while (line >> key) {
+        if (key == "noise") {
+          blob.amplitude = value(line);
+          blob.frequency = value(line);
+        } else if (key == "union" || key == "intersect" || key == "subtract") {
+          blob.operation = key == "union" ? Blob::Union : key == "intersect" ? Blob::Intersection : Blob::Subtraction;
+          blob.otherRadius = value(line);
+          blob.otherCenter = vector3(line);
+        } else {
+          fail("Unknown blob property " + key);
+        }
+      }
+      blobs.push_back(blob);
+    } else if (keyword == "mesh") {
+      string geometryName, path;
+      if (!(line >> geometryName >> path)) fail("Expected a mesh name and obj file");
+      geometryNames[geometryName] = (uint32_t) geometries.size();
+      geometries.push_back(loadGeometry(directory + path));
+    } else if (keyword == "instance") {
+      string geometryName, materialName;
+      if (!(line >> geometryName >> materialName)) fail("Expected a mesh and material name");
+      Instance instance{lookup(geometryNames, geometryName, "mesh"), lookup(materialNames, materialName, "material"), dmat4{1.0}, {}};
+      while (line >> key) {
+        if (key == "translate") {
+          instance.transform = translate(instance.transform, vector3(line));
+        } else if (key == "rotate") {
+          auto axis = vector3(line);
+          instance.transform = rotate(instance.transform, radians(value(line)), axis);
+        } else if (key == "scale") {
+          instance.transform = scale(instance.transform, vector3(line));
+        } else {
+          fail("Unknown transformation " + key);
+        }
+      }
+      instances.push_back(instance);
+    } else if (keyword == "key") {
+      string target;
+      if (!(line >> target)) fail("Expected camera, sphere or instance");
+      if (target == "camera") {
+        // Static camera is the keyframe at frame 0 until one is given
+        if (cameraKeys.empty()) cameraKeys.push_back({0, camera});
+        CameraKey cameraKey{value(line), camera};
+        while (line >> key) {
+          if (key == "position") cameraKey.camera.position = vector3(line);
+          else if (key == "back") cameraKey.camera.back = vector3(line);
+          else if (key == "up") cameraKey.camera.up = vector3(line);
+          else if (key == "right") cameraKey.camera.right = vector3(line);
+          else fail("Unknown camera property " + key);
+        }
+        insert(cameraKeys, cameraKey);
+      } else if (target == "sphere") {
+        auto index = value(line);
+        if (index < 0 || index >= (double) spheres.size()) fail("Sphere index out of range");
+        auto &sphere = spheres[(size_t) index];
+        if (sphere.keys.empty()) sphere.keys.push_back({0, sphere.center});
+        auto frame = value(line);
+        insert(sphere.keys, Sphere::Key{frame, vector3(line)});
+      } else if (target == "instance") {
+        auto index = value(line);
+        if (index < 0 || index >= (double) instances.size()) fail("Instance index out of range");
+        auto &instance = instances[(size_t) index];
+        if (instance.keys.empty()) instance.keys.push_back({0, {0, 0, 0}, dquat{1, 0, 0, 0}});
+        Instance::Key motion{value(line), {0, 0, 0}, dquat{1, 0, 0, 0}};
+        while (line >> key) {
+          if (key == "translate") {
+            motion.translation = vector3(line);
+          } else if (key == "rotate") {
+            auto axis = vector3(line);
+            motion.rotation = angleAxis(radians(value(line)), normalize(axis));
+          } else {
+            fail("Unknown instance motion " + key);
+          }
+        }
+        insert(instance.keys, motion);
+      } else {
+        fail("Unknown keyframe target " + target);
+      }
+    } else {
+      fail("Unknown keyword " + keyword);
+    }
+
+    // Properties without keys are positional, anything left over is a mistake
+    if (!line.eof()) {
+      line.clear();
+      if (line >> key) fail("Unexpected " + key);
+    }
+  }
+}
@@ -0,0 +1,171 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace ppgso {
+
+  /*!
+   * Scene description for the ray tracers loaded from a text file, so scenes can change without recompiling.
+   * Each line starts with a keyword, everything after # is a comment. Materials and meshes are named and referenced
+   * by the lines that follow them, mesh paths are relative to the scene file:
+   *
+   *   camera position 0 0 25 back 0 0 1 up 0 .5 0 right .5 0 0
+   *   material glass diffuse .7 .7 0 reflectivity 1 transparency .95 refraction 1.52
+   *   material lamp emission 1 1 1 diffuse .8 .8 .8 shininess 1
+   *   light -5 5 9  1 1 1  1 .1 0          # position, color, constant, linear and quadratic attenuation
+   *   sphere glass 2  -5 -8 3              # material, radius, center
+   *   blob rock 3  0 -6 0 noise .4 1.5 subtract 1.5  2 -4 2
+   *   mesh ship corsair.obj
+   *   instance ship glass translate 5 -6 4 rotate 0 1 0 90 scale 8 8 8
+   *
+   * Blobs are spheres displaced by noise of given amplitude and frequency, optionally combined with a second sphere by
+   * union, intersect or subtract. Material properties not listed are 0, except shininess which is 1. Instance transformations are applied in the
+   * order of a matrix product, so the last one listed acts on the mesh first. Each mesh file is parsed once no matter
+   * how many instances use it, but the ray tracers copy its triangles into every instance.
+   *
+   * Animated sequences are described by keyframes that are linearly interpolated between frames. Spheres and instances
+   * are referenced by their index in the order they appear, their description acts as a keyframe at frame 0:
+   *
+   *   key camera 24 position 20 0 15 back .8 0 .6     # frame, camera vectors, the others keep their static value
+   *   key sphere 6 24  -5 -4 3                         # sphere, frame, center
+   *   key instance 0 24 translate 0 2 0 rotate 0 1 0 90
+   *
+   * Instance keys rotate the mesh about its own origin and translate it in the scene, rotations are interpolated along
+   * the shorter arc so keys should be less than 180 degrees apart.
+   */
+  class SceneFile {
+  public:
+    struct Camera {
+      glm::dvec3 position{0, 0, 0}, back{0, 0, 1}, up{0, .5, 0}, right{.5, 0, 0};
+    };
+
+    struct CameraKey {
+      double frame;
+      Camera camera;
+    };
+
+    /*!
+     * Union of the material properties of all ray tracers, each uses the ones it supports
+     */
+    struct Material {
+      glm::dvec3 emission{0, 0, 0}, diffuse{0, 0, 0};
+      double shininess = 1, reflectivity = 0, transparency = 0, refractionIndex = 0;
+    };
+
+    struct Light {
+      glm::dvec3 position, color;
+      double constant, linear, quadratic;
+    };
+
+    struct Sphere {
+      double radius;
+      glm::dvec3 center;
+      uint32_t material;
+
+      struct Key {
+        double frame;
+        glm::dvec3 center;
+      };
+      // Keyframes sorted by frame, empty for static spheres
+      std::vector<Key> keys;
+
+      /*!
+       * Interpolate the sphere position
+       * @param frame - Frame to interpolate at.
+       * @return - Center of the sphere.
+       */
+      glm::dvec3 centerAt(double frame) const;
+    };
+
+    /*!
+     * Signed distance field shape, a sphere displaced by noise and optionally combined with a second sphere
+     */
+    struct Blob {
+      enum Operation { None, Union, Intersection, Subtraction };
+
+      double radius;
+      glm::dvec3 center;
+      uint32_t material;
+      double amplitude = 0, frequency = 1;
+      Operation operation = None;
+      double otherRadius = 0;
+      glm::dvec3 otherCenter{0, 0, 0};
+    };
+
+    /*!
+     * Triangles of a mesh in model space, three consecutive vertices form a triangle
+     */
+    struct Geometry {
+      std::vector<glm::vec3> vertices;
+    };
+
+    /*!
+     * Placement of a mesh in the scene
+     */
+    struct Instance {
+      uint32_t geometry, material;
+      glm::dmat4 transform;
+
+      struct Key {
+        double frame;
+        glm::dvec3 translation;
+        glm::dquat rotation;
+      };
+      // Keyframes sorted by frame, empty for static instances
+      std::vector<Key> keys;
+
+      /*!
+       * Interpolate the instance placement
+       * @param frame - Frame to interpolate at.
+       * @return - Transformation of the mesh vertices.
+       */
+      glm::dmat4 transformAt(double frame) const;
+    };
+
+    Camera camera;
+    // Keyframes of the camera sorted by frame, empty for a static camera
+    std::vector<CameraKey> cameraKeys;
+    std::vector<Material> materials;
+    std::vector<Light> lights;
+    std::vector<Sphere> spheres;
+    std::vector<Blob> blobs;
+    std::vector<Geometry> geometries;
+    std::vector<Instance> instances;
+
+    /*!
+     * Load scene from a file
+     * @param path - File path to the scene file.
+     */
+    SceneFile(const std::string &path);
+
+    /*!
+     * Parse scene from a stream
+     * @param stream - Stream with the scene description.
+     * @param directory - Directory the mesh paths are relative to.
+     * @param name - Name of the stream used in error messages.
+     */
+    SceneFile(std::istream &stream, const std::string &directory, const std::string &name);
+
+    /*!
+     * Load triangles of a Wavefront obj file
+     * @param obj - File path to the obj file to load.
+     * @return - Triangles of all shapes in the file.
+     */
+    static Geometry loadGeometry(const std::string &obj);
+
+    /*!
+     * Interpolate the camera
+     * @param frame - Frame to interpolate at.
+     * @return - Camera of the frame.
+     */
+    Camera cameraAt(double frame) const;
+
+  private:
+    void parse(std::istream &stream, const std::string &directory, const std::string &name);
+  };
+}
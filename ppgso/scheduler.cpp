@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <mutex>
+
+#include "scheduler.h"
+
+using namespace std;
+using namespace ppgso;
+
+namespace {
+  // Interleave bits of the tile coordinates, neighbouring codes are neighbouring tiles
+  uint64_t morton(uint32_t x, uint32_t y) {
+    uint64_t code = 0;
+    for (int bit = 0; bit < 32; bit++) {
+      code |= (uint64_t) ((x >> bit) & 1) << (2 * bit);
+      code |= (uint64_t) ((y >> bit) & 1) << (2 * bit + 1);
+    }
+    return code;
+  }
+
+  uint64_t pack(uint32_t begin, uint32_t end) {
+    return (uint64_t) end << 32 | begin;
+  }
+}
+
+TileScheduler::TileScheduler(int width, int height, int tileSize, unsigned threads) {
+  vector<pair<uint64_t, Tile>> ordered;
+  for (int y = 0; y < height; y += tileSize)
+    for (int x = 0; x < width; x += tileSize)
+      ordered.push_back({morton(x / tileSize, y / tileSize), {x, y, min(tileSize, width - x), min(tileSize, height - y)}});
+  sort(ordered.begin(), ordered.end(), [](const pair<uint64_t, Tile> &a, const pair<uint64_t, Tile> &b) {
+    return a.first < b.first;
+  });
+  for (auto &entry : ordered)
+    tiles.push_back(entry.second);
+
+  this->threads = threads > 0 ? threads : max(thread::hardware_concurrency(), 1u);
+  ranges.reset(new Range[this->threads]);
+}
+
+TileScheduler::~TileScheduler() {
+  {
+    lock_guard<mutex> lock{poolMutex};
+    stopping = true;
+  }
+  started.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+}
+
+void TileScheduler::run(const function<void(const Tile &, unsigned)> &process) {
+  run((uint32_t) tiles.size(), [&](uint32_t tile, unsigned thread) {
+    process(tiles[tile], thread);
+  });
+}
+
+void TileScheduler::run(uint32_t count, const function<void(uint32_t, unsigned)> &process) {
+  // Give each thread an equal contiguous part of the items, for tiles this is a part of the curve
+  for (unsigned i = 0; i < threads; i++)
+    ranges[i].bounds = pack((uint32_t) ((uint64_t) count * i / threads), (uint32_t) ((uint64_t) count * (i + 1) / threads));
+
+  {
+    lock_guard<mutex> lock{poolMutex};
+    // Schedulers that only split images never start any threads
+    for (auto i = (unsigned) workers.size() + 1; i < threads; i++)
+      workers.emplace_back(&TileScheduler::park, this, i);
+    job = &process;
+    error = nullptr;
+    busy = threads - 1;
+    generation++;
+  }
+  started.notify_all();
+  work(0);
+
+  unique_lock<mutex> lock{poolMutex};
+  finished.wait(lock, [&]() { return busy == 0; });
+  job = nullptr;
+  if (error) rethrow_exception(error);
+}
+
+unsigned TileScheduler::getThreads() const {
+  return threads;
+}
+
+const vector<Tile> &TileScheduler::getTiles() const {
+  return tiles;
+}
+
+void TileScheduler::work(unsigned thread) {
+  try {
+    uint32_t item;
+    while (next(thread, item))
+      (*job)(item, thread);
+  } catch (...) {
+    lock_guard<mutex> lock{poolMutex};
+    if (!error) error = current_exception();
+  }
+}
+
+void TileScheduler::park(unsigned thread) {
+  uint64_t seen = 0;
+  while (true) {
+    {
+      unique_lock<mutex> lock{poolMutex};
+      started.wait(lock, [&]() { return stopping || generation != seen; });
+      if (stopping) return;
+      seen = generation;
+    }
+    work(thread);
+
+    lock_guard<mutex> lock{poolMutex};
+    if (--busy == 0) finished.notify_one();
+  }
+}
+
+bool TileScheduler::next(unsigned thread, uint32_t &tile) {
+  // Take tiles from the front of the own range
+  auto &own = ranges[thread].bounds;
+  auto bounds = own.load();
+  while ((uint32_t) bounds < (uint32_t) (bounds >> 32)) {
+    if (own.compare_exchange_weak(bounds, bounds + 1)) {
+      tile = (uint32_t) bounds;
+      return true;
+    }
+  }
+
+  // Steal from the back of other ranges so the owner keeps working on tiles close to each other
+  for (unsigned i = 1; i < threads; i++) {
+    auto &other = ranges[(thread + i) % threads].bounds;
+    bounds = other.load();
+    while ((uint32_t) bounds < (uint32_t) (bounds >> 32)) {
+      auto end = (uint32_t) (bounds >> 32) - 1;
+      if (other.compare_exchange_weak(bounds, pack((uint32_t) bounds, end))) {
+        tile = end;
+        return true;
+      }
+    }
+  }
+  return false;
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ppgso {
+
+  /*!
+   * Rectangular block of pixels processed as a single unit of work
+   */
+  struct Tile {
+    int x, y, width, height;
+  };
+
+  /*!
+   * Distribute image tiles to worker threads with work stealing.
+   * Tiles are ordered along a Morton curve so tiles processed one after another stay close in the image,
+   * each thread starts with a contiguous range of them and steals from the end of other ranges once its own range runs out.
+   * Per-pixel cost can vary a lot, so threads keep busy until the last tile is taken instead of waiting on a fixed partition.
+   * Worker threads are started by the first run and stay parked on a condition variable between runs until the scheduler is destroyed.
+   */
+  class TileScheduler {
+  public:
+    /*!
+     * Split an image into tiles
+     * @param width - Width of the image in pixels.
+     * @param height - Height of the image in pixels.
+     * @param tileSize - Width and height of a tile, tiles on the right and bottom border may be smaller.
+     * @param threads - Number of worker threads, 0 uses all hardware threads.
+     */
+    TileScheduler(int width, int height, int tileSize = 16, unsigned threads = 0);
+
+    TileScheduler(const TileScheduler &) = delete;
+    TileScheduler &operator=(const TileScheduler &) = delete;
+
+    /*!
+     * Stop and join the worker threads.
+     */
+    ~TileScheduler();
+
+    /*!
+     * Process all tiles, returns when the last tile is finished.
+     * The calling thread works as thread 0, exceptions thrown by the callback are rethrown after all threads finish.
+     * Only one run may be in progress at a time.
+     * @param process - Callback void(const Tile &tile, unsigned thread) called once for each tile.
+     */
+    void run(const std::function<void(const Tile &, unsigned)> &process);
+
+    /*!
+     * Process numbered items that are not tiles of the image with the same threads and work stealing.
+     * Each thread starts with an equal contiguous range of the items, so with as many items as threads each thread
+     * takes one unless it runs out of work early.
+     * @param count - Number of items.
+     * @param process - Callback void(uint32_t item, unsigned thread) called once for each item index smaller than count.
+     */
+    void run(uint32_t count, const std::function<void(uint32_t, unsigned)> &process);
+
+    /*!
+     * Get number of worker threads, use to allocate per thread buffers
+     * @return - Number of threads, the thread index passed to the callback is smaller than this.
+     */
+    unsigned getThreads() const;
+
+    /*!
+     * Get tiles in the order they are processed
+     * @return - Tiles sorted along the Morton curve.
+     */
+    const std::vector<Tile> &getTiles() const;
+
+  private:
+    // Remaining tiles of a thread, begin in the lower and end in the upper 32 bits so both ends are updated atomically
+    struct Range {
+      std::atomic<uint64_t> bounds;
+      // Keep ranges of different threads in separate cache lines
+      char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    /*!
+     * Take next tile from the own range or steal one from another thread
+     * @param thread - Index of the thread asking for work.
+     * @param tile - Output index of the tile to process.
+     * @return - False when no tiles are left.
+     */
+    bool next(unsigned thread, uint32_t &tile);
+
+    /*!
+     * Process items of the current job until none are left, exceptions are stored for the caller of run
+     * @param thread - Index of the working thread.
+     */
+    void work(unsigned thread);
+
+    /*!
+     * Main loop of a worker thread, waits for the next job and works on it until the scheduler is destroyed
+     * @param thread - Index of the worker thread.
+     */
+    void park(unsigned thread);
+
+    std::vector<Tile> tiles;
+    unsigned threads;
+    std::unique_ptr<Range[]> ranges;
+
+    // Persistent worker threads, the members below are guarded by poolMutex
+    std::vector<std::thread> workers;
+    std::mutex poolMutex;
+    std::condition_variable started, finished;
+    // Incremented for each job so parked workers recognize a new one
+    uint64_t generation = 0;
+    // Number of worker threads still working on the current job
+    unsigned busy = 0;
+    bool stopping = false;
+    const std::function<void(uint32_t, unsigned)> *job = nullptr;
+    std::exception_ptr error;
+  };
+}
@@ -1,5 +1,15 @@
 #include <iostream>
+#include <iomanip>
+#include <fstream>
 #include <sstream>
+#include <cstring>
+
+#ifdef _WIN32
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#else
+#include <sys/stat.h>
+#endif
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
@@ -12,7 +22,40 @@ using namespace std;
 using namespace glm;
 using namespace ppgso;
 
-Shader::Shader(const string &vertex_shader_code, const string &fragment_shader_code) {
+Shader::Shader(const string &vertex_shader_code, const string &fragment_shader_code, const vector<string> &defines) {
+  auto vertex_code = specialize(vertex_shader_code, defines);
+  auto fragment_code = specialize(fragment_shader_code, defines);
+
+  // Reuse the program binary from a previous run when the driver accepts it
+  auto key = binaryKey(vertex_code, fragment_code);
+  program = loadBinary(key);
+
+  if (!program) {
+    program = compile(vertex_code, fragment_code);
+    saveBinary(key);
+  }
+
+  loadUniforms();
+  use();
+}
+
+string Shader::specialize(const string &code, const vector<string> &defines) {
+  if (defines.empty()) return code;
+
+  stringstream lines;
+  for (auto &define : defines)
+    lines << "#define " << define << endl;
+
+  // Defines have to follow the #version directive which must come first
+  auto version = code.find("#version");
+  if (version == string::npos) return lines.str() + code;
+
+  auto end = code.find('\n', version);
+  if (end == string::npos) return code + "\n" + lines.str();
+  return code.substr(0, end + 1) + lines.str() + code.substr(end + 1);
+}
+
+GLuint Shader::compile(const string &vertex_shader_code, const string &fragment_shader_code) {
   // Create shaders
   auto vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
   auto fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
@@ -60,6 +103,8 @@ Shader::Shader(const string &vertex_shader_code, const string &fragment_shader_c
   glAttachShader(program_id, vertex_shader_id);
   glAttachShader(program_id, fragment_shader_id);
   glBindFragDataLocation(program_id, 0, "FragmentColor");
+  if (binarySupported())
+    glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
   glLinkProgram(program_id);
 
   // Check program log
@@ -76,16 +121,295 @@ Shader::Shader(const string &vertex_shader_code, const string &fragment_shader_c
   glDeleteShader(vertex_shader_id);
   glDeleteShader(fragment_shader_id);
 
-  program = program_id;
-  use();
+  return program_id;
+}
+
+bool Shader::binarySupported() {
+  if (binaryCache.empty() || !(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)) return false;
+
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  return formats > 0;
+}
+
+uint64_t Shader::binaryKey(const string &vertex_shader_code, const string &fragment_shader_code) {
+  // Binaries are only valid for the same sources on the same driver
+  string driver;
+  for (auto name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+    auto value = glGetString(name);
+    if (value) driver += (const char *) value;
+    driver += '\n';
+  }
+
+  // 64bit FNV-1a hash, stable between runs unlike std::hash
+  uint64_t hash = 14695981039346656037ULL;
+  const string *parts[] = {&vertex_shader_code, &fragment_shader_code, &driver};
+  for (auto part : parts) {
+    for (auto c : *part) {
+      hash ^= (unsigned char) c;
+      hash *= 1099511628211ULL;
+    }
+    // Separate the parts so moving text between them changes the hash
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+string Shader::binaryPath(uint64_t key) {
+  stringstream path;
+  path << binaryCache << "/" << hex << setw(16) << setfill('0') << key << ".bin";
+  return path.str();
+}
+
+GLuint Shader::loadBinary(uint64_t key) {
+  if (!binarySupported()) return 0;
+
+  ifstream file{binaryPath(key), ios::binary};
+  if (!file) return 0;
+
+  // Header is the key, binary format and size of the binary data
+  uint64_t file_key = 0;
+  GLenum format = 0;
+  GLsizei length = 0;
+  file.read((char *) &file_key, sizeof(file_key));
+  file.read((char *) &format, sizeof(format));
+  file.read((char *) &length, sizeof(length));
+  if (!file || file_key != key || length <= 0) return 0;
+
+  vector<char> binary((unsigned long) length);
+  file.read(binary.data(), length);
+  if (!file) return 0;
+
+  // The driver rejects binaries it can no longer use, eg. after an update
+  auto program_id = glCreateProgram();
+  glProgramBinary(program_id, format, binary.data(), length);
+
+  auto result = GL_FALSE;
+  glGetProgramiv(program_id, GL_LINK_STATUS, &result);
+  if (result == GL_FALSE) {
+    glDeleteProgram(program_id);
+    return 0;
+  }
+  return program_id;
+}
+
+void Shader::saveBinary(uint64_t key) const {
+  if (!binarySupported()) return;
+
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) return;
+
+  vector<char> binary((unsigned long) length);
+  GLenum format = 0;
+  glGetProgramBinary(program, length, &length, &format, binary.data());
+
+  // Failing to write the cache is not an error, the program will be compiled again next time
+  mkdir(binaryCache.c_str(), 0755);
+  ofstream file{binaryPath(key), ios::binary};
+  file.write((const char *) &key, sizeof(key));
+  file.write((const char *) &format, sizeof(format));
+  file.write((const char *) &length, sizeof(length));
+  file.write(binary.data(), length);
 }
 
 Shader::~Shader() {
+  // The program name may be reused by OpenGL for a new program
+  if (current == program) current = 0;
   glDeleteProgram( program );
+
+  // Release uniform buffers no other program uses
+  auto &blocks = getBlocks();
+  for (auto &blockName : blockNames) {
+    auto &block = blocks[blockName];
+    if (--block.users > 0) continue;
+    glDeleteBuffers(1, &block.buffer);
+    blocks.erase(blockName);
+  }
+}
+
+GLuint Shader::current = 0;
+unsigned long Shader::avoidedCalls = 0;
+string Shader::binaryCache = "shader_cache";
+
+namespace {
+  // Name of an active uniform, arrays are reported as "name[0]" and addressed by name only
+  string activeUniformName(GLuint program, GLuint index, GLint max_length) {
+    string name((unsigned long) max_length, '\0');
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(program, index, max_length, &length, &size, &type, &name[0]);
+    name.resize((unsigned long) length);
+
+    auto bracket = name.find('[');
+    if (bracket != string::npos) name.resize(bracket);
+    return name;
+  }
+}
+
+map<string, Shader::UniformBlock> &Shader::getBlocks() {
+  // Never destroyed, static programs of other translation units may release their blocks after it otherwise
+  static auto &blocks = *new map<string, UniformBlock>;
+  return blocks;
+}
+
+map<string, GLint> Shader::getBlockMembers(GLuint index) const {
+  GLint count = 0, max_length = 0;
+  glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+  vector<GLint> indices((unsigned long) count);
+  if (count > 0) glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, indices.data());
+
+  map<string, GLint> members;
+  for (auto member : indices) {
+    auto uniform = (GLuint) member;
+    GLint offset = 0;
+    glGetActiveUniformsiv(program, 1, &uniform, GL_UNIFORM_OFFSET, &offset);
+    members[activeUniformName(program, uniform, max_length)] = offset;
+  }
+  return members;
+}
+
+void Shader::loadUniforms() {
+  // Bind uniform blocks to buffers shared by all programs
+  auto &blocks = getBlocks();
+  GLint block_count = 0, max_length = 0;
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &block_count);
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_length);
+
+  vector<UniformBlock*> programBlocks;
+  for (GLint i = 0; i < block_count; i++) {
+    string name((unsigned long) max_length, '\0');
+    GLsizei length = 0;
+    GLint size = 0;
+    glGetActiveUniformBlockName(program, (GLuint) i, max_length, &length, &name[0]);
+    name.resize((unsigned long) length);
+    glGetActiveUniformBlockiv(program, (GLuint) i, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+    auto members = getBlockMembers((GLuint) i);
+
+    auto found = blocks.find(name);
+    if (found == blocks.end()) {
+      // Pick the first binding point not used by other blocks
+      GLuint binding = 0;
+      for (bool used = true; used; ) {
+        used = false;
+        for (auto &other : blocks) if (other.second.binding == binding) used = true;
+        if (used) binding++;
+      }
+
+      GLint max_bindings = 0;
+      glGetIntegerv(GL_MAX_UNIFORM_BUFFER_BINDINGS, &max_bindings);
+      if ((GLint) binding >= max_bindings) {
+        stringstream msg;
+        msg << "Uniform block " << name << " needs binding point " << binding << " but only " << max_bindings
+            << " uniform buffer bindings are available ..." << endl;
+        throw runtime_error(msg.str());
+      }
+
+      UniformBlock block{0, binding, 0, members, vector<unsigned char>((unsigned long) size, 0)};
+      glGenBuffers(1, &block.buffer);
+      glBindBuffer(GL_UNIFORM_BUFFER, block.buffer);
+      glBufferData(GL_UNIFORM_BUFFER, size, block.data.data(), GL_DYNAMIC_DRAW);
+      glBindBufferBase(GL_UNIFORM_BUFFER, binding, block.buffer);
+      found = blocks.insert({name, block}).first;
+    } else if ((GLint) found->second.data.size() != size || found->second.offsets != members) {
+      stringstream msg;
+      msg << "Uniform block " << name << " is declared with different layouts ..." << endl;
+      throw runtime_error(msg.str());
+    }
+
+    found->second.users++;
+    blockNames.push_back(name);
+    programBlocks.push_back(&found->second);
+    glUniformBlockBinding(program, (GLuint) i, found->second.binding);
+  }
+
+  // Collect active uniforms, including members of the blocks
+  GLint count = 0;
+  glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+  uniforms.clear();
+  for (GLint i = 0; i < count; i++) {
+    auto index = (GLuint) i;
+    auto name = activeUniformName(program, index, max_length);
+
+    GLint block_index = -1, offset = 0;
+    GLint type = 0;
+    glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_TYPE, &type);
+    glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_BLOCK_INDEX, &block_index);
+    glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_OFFSET, &offset);
+
+    // Offsets of the block members were collected with the block
+    UniformBlock *block = block_index >= 0 ? programBlocks[block_index] : nullptr;
+
+    uniforms.push_back({name, glGetUniformLocation(program, name.c_str()), (GLenum) type, block, offset, false, {}});
+  }
+}
+
+Shader::Uniform *Shader::findUniform(const string &name) const {
+  // Location lookup is served from the table
+  avoidedCalls++;
+
+  for (auto &uniform : uniforms)
+    if (uniform.name == name) return &uniform;
+
+  return nullptr;
+}
+
+bool Shader::store(Uniform *uniform, const void *value, size_t size) const {
+  // Unknown or inactive uniform, nothing to upload
+  if (!uniform) {
+    avoidedCalls++;
+    return false;
+  }
+
+  if (uniform->block) {
+    writeBlock(*uniform->block, uniform->offset, value, size);
+    return false;
+  }
+
+  // Skip the upload when the same value is already set
+  if (uniform->initialized && memcmp(uniform->value, value, size) == 0) {
+    avoidedCalls++;
+    return false;
+  }
+
+  memcpy(uniform->value, value, size);
+  uniform->initialized = true;
+  return true;
+}
+
+void Shader::writeBlock(UniformBlock &block, GLint offset, const void *value, size_t size) {
+  auto data = &block.data[offset];
+  if (memcmp(data, value, size) == 0) {
+    avoidedCalls++;
+    return;
+  }
+
+  memcpy(data, value, size);
+  glBindBuffer(GL_UNIFORM_BUFFER, block.buffer);
+  glBufferSubData(GL_UNIFORM_BUFFER, offset, (GLsizeiptr) size, value);
+}
+
+void Shader::writeShared(const string &name, const void *value, size_t size) {
+  for (auto &block : getBlocks()) {
+    auto offset = block.second.offsets.find(name);
+    if (offset == block.second.offsets.end()) continue;
+    writeBlock(block.second, offset->second, value, size);
+    return;
+  }
 }
 
 void Shader::use() const {
+  if (current == program) {
+    avoidedCalls++;
+    return;
+  }
   glUseProgram(program);
+  current = program;
 }
 
 GLuint Shader::getAttribLocation(const string &name) const {
@@ -95,32 +419,46 @@ GLuint Shader::getAttribLocation(const string &name) const {
 
 GLuint Shader::getUniformLocation(const string &name) const {
   use();
-  return (GLuint) glGetUniformLocation(program, name.c_str());
+  for (auto &uniform : uniforms)
+    if (uniform.name == name) return (GLuint) uniform.location;
+  return (GLuint) -1;
 }
 
 void Shader::setUniform(const std::string &name, const Texture &texture, const int id) const {
   use();
-  auto uniform = getUniformLocation(name.c_str());
-  glUniform1i(uniform, id);
+  auto uniform = findUniform(name);
+  if (store(uniform, &id, sizeof(id)))
+    glUniform1i(uniform->location, id);
   texture.bind(id);
 }
 
 void Shader::setUniform(const std::string &name, glm::mat4 matrix) const {
   use();
-  auto uniform = getUniformLocation(name.c_str());
-  glUniformMatrix4fv(uniform, 1, GL_FALSE, value_ptr(matrix));
+  auto uniform = findUniform(name);
+  if (!store(uniform, value_ptr(matrix), sizeof(matrix))) return;
+  glUniformMatrix4fv(uniform->location, 1, GL_FALSE, value_ptr(matrix));
 }
 
 void Shader::setUniform(const std::string &name, glm::mat3 matrix) const {
   use();
-  auto uniform = getUniformLocation(name.c_str());
-  glUniformMatrix3fv(uniform, 1, GL_FALSE, value_ptr(matrix));
+  auto uniform = findUniform(name);
+
+  // Matrix columns are padded to vec4 inside std140 uniform blocks
+  if (uniform && uniform->block) {
+    mat3x4 padded{matrix};
+    store(uniform, value_ptr(padded), sizeof(padded));
+    return;
+  }
+
+  if (!store(uniform, value_ptr(matrix), sizeof(matrix))) return;
+  glUniformMatrix3fv(uniform->location, 1, GL_FALSE, value_ptr(matrix));
 }
 
 void Shader::setUniform(const std::string &name, float value) const {
   use();
-  auto uniform = getUniformLocation(name.c_str());
-  glUniform1f(uniform, value);
+  auto uniform = findUniform(name);
+  if (!store(uniform, &value, sizeof(value))) return;
+  glUniform1f(uniform->location, value);
 }
 
 GLuint Shader::getProgram() const {
@@ -129,18 +467,45 @@ GLuint Shader::getProgram() const {
 
 void Shader::setUniform(const std::string &name, glm::vec2 vector) const {
   use();
-  auto uniform = getUniformLocation(name.c_str());
-  glUniform2fv(uniform, 1, value_ptr(vector));
+  auto uniform = findUniform(name);
+  if (!store(uniform, value_ptr(vector), sizeof(vector))) return;
+  glUniform2fv(uniform->location, 1, value_ptr(vector));
 }
 
 void Shader::setUniform(const std::string &name, glm::vec3 vector) const {
   use();
-  auto uniform = getUniformLocation(name.c_str());
-  glUniform3fv(uniform, 1, value_ptr(vector));
+  auto uniform = findUniform(name);
+  if (!store(uniform, value_ptr(vector), sizeof(vector))) return;
+  glUniform3fv(uniform->location, 1, value_ptr(vector));
 }
 
 void Shader::setUniform(const std::string &name, glm::vec4 vector) const {
   use();
-  auto uniform = getUniformLocation(name.c_str());
-  glUniform4fv(uniform, 1, value_ptr(vector));
+  auto uniform = findUniform(name);
+  if (!store(uniform, value_ptr(vector), sizeof(vector))) return;
+  glUniform4fv(uniform->location, 1, value_ptr(vector));
+}
+
+void Shader::setSharedUniform(const std::string &name, glm::mat4 matrix) {
+  writeShared(name, value_ptr(matrix), sizeof(matrix));
+}
+
+void Shader::setSharedUniform(const std::string &name, glm::vec3 vector) {
+  writeShared(name, value_ptr(vector), sizeof(vector));
+}
+
+void Shader::setSharedUniform(const std::string &name, glm::vec4 vector) {
+  writeShared(name, value_ptr(vector), sizeof(vector));
+}
+
+void Shader::setSharedUniform(const std::string &name, float value) {
+  writeShared(name, &value, sizeof(value));
+}
+
+void Shader::setBinaryCache(const std::string &directory) {
+  binaryCache = directory;
+}
+
+unsigned long Shader::getAvoidedCalls() {
+  return avoidedCalls;
 }
@@ -1,5 +1,8 @@
 #pragma once
+#include <cstdint>
 #include <string>
+#include <vector>
+#include <map>
 #include <memory>
 
 #include <GL/glew.h>
@@ -14,16 +17,24 @@ namespace ppgso {
 
     /*!
      * Compile and manage an GLSL program and its inputs.
+     * Linked program binaries are stored in the binary cache directory and reused on later runs
+     * with the same sources and driver, which skips the compilation entirely.
+     *
+     * Shader variants are selected by a list of preprocessor defines that are inserted after the #version line,
+     * each combination of defines results in its own specialized program.
      *
      * @param vertex_shader_code - String containing the source of the vertex shader.
      * @param fragment_shader_code - String containing the source of the fragment shader.
+     * @param defines - Names to #define in both shaders (empty by default).
      */
-    Shader(const std::string &vertex_shader_code, const std::string &fragment_shader_code);
+    Shader(const std::string &vertex_shader_code, const std::string &fragment_shader_code,
+           const std::vector<std::string> &defines = {});
 
     ~Shader();
 
     /*!
      * Set up the program for use in OpenGL state.
+     * The call to glUseProgram is skipped when the program is already in use.
      */
     void use() const;
 
@@ -37,6 +48,7 @@ namespace ppgso {
 
     /*!
      * Get OpenGL uniform location for for the input specified by "name"
+     * The locations are looked up once when the program is linked.
      *
      * @param name - Name of the shader program input variable.
      * @return - OpenGL attribute location number.
@@ -52,6 +64,7 @@ namespace ppgso {
 
     /*!
      * Set a floating point value as an input for the shader program variable "name"
+     * The program is bound using use(), only the upload of an unchanged value is skipped.
      *
      * @param name - Name of the shader program uniform input variable.
      * @param value - Value to set input to.
@@ -60,6 +73,7 @@ namespace ppgso {
 
     /*!
      * Set a vector as an input for the shader program variable "name"
+     * The program is bound using use(), only the upload of an unchanged value is skipped.
      *
      * @param name - Name of the shader program uniform input variable.
      * @param vector - Vector to set input to.
@@ -68,6 +82,7 @@ namespace ppgso {
 
     /*!
      * Set a vector as an input for the shader program variable "name"
+     * The program is bound using use(), only the upload of an unchanged value is skipped.
      *
      * @param name - Name of the shader program uniform input variable.
      * @param vector - Vector to set input to.
@@ -76,6 +91,7 @@ namespace ppgso {
 
     /*!
      * Set a vector as an input for the shader program variable "name"
+     * The program is bound using use(), only the upload of an unchanged value is skipped.
      *
      * @param name - Name of the shader program uniform input variable.
      * @param vector - Vector to set input to.
@@ -84,6 +100,7 @@ namespace ppgso {
 
     /*!
      * Set texture as an input for the shader program variable "name"
+     * The program is bound using use(), only the upload of an unchanged value is skipped.
      * OpenGL texture id needs to be set when dealing with multiple textures.
      *
      * @param name - Name of the shader program uniform input variable.
@@ -94,6 +111,7 @@ namespace ppgso {
 
     /*!
      * Set matrix as an input for the shader program variable "name"
+     * The program is bound using use(), only the upload of an unchanged value is skipped.
      *
      * @param name - Name of the shader program uniform input variable.
      * @param matrix - Matrix to set input to.
@@ -102,15 +120,214 @@ namespace ppgso {
 
     /*!
      * Set matrix as an input for the shader program variable "name"
+     * The program is bound using use(), only the upload of an unchanged value is skipped.
      *
      * @param name - Name of the shader program uniform input variable.
      * @param matrix - Matrix to set input to.
      */
     void setUniform(const std::string &name, glm::mat3 matrix) const;
 
+    /*!
+     * Set a value in a uniform block shared by all shader programs.
+     * Uniform blocks declared with the same name in multiple programs are backed by a single uniform buffer,
+     * so per-frame data such as camera matrices only needs to be written once for all programs.
+     * Calling setUniform with the name of a block member writes to the same buffer.
+     *
+     * @param name - Name of the uniform block member.
+     * @param matrix - Matrix to set the member to.
+     */
+    static void setSharedUniform(const std::string &name, glm::mat4 matrix);
+
+    /*!
+     * Set a vector in a uniform block shared by all shader programs.
+     *
+     * @param name - Name of the uniform block member.
+     * @param vector - Vector to set the member to.
+     */
+    static void setSharedUniform(const std::string &name, glm::vec3 vector);
+
+    /*!
+     * Set a vector in a uniform block shared by all shader programs.
+     *
+     * @param name - Name of the uniform block member.
+     * @param vector - Vector to set the member to.
+     */
+    static void setSharedUniform(const std::string &name, glm::vec4 vector);
+
+    /*!
+     * Set a floating point value in a uniform block shared by all shader programs.
+     *
+     * @param name - Name of the uniform block member.
+     * @param value - Value to set the member to.
+     */
+    static void setSharedUniform(const std::string &name, float value);
+
+    /*!
+     * Set directory used to store linked program binaries.
+     * The directory is created when needed, an empty string disables the cache.
+     *
+     * @param directory - Path to the cache directory ("shader_cache" by default).
+     */
+    static void setBinaryCache(const std::string &directory);
+
+    /*!
+     * Get the number of OpenGL calls that were skipped by all shader programs.
+     * This counts redundant glUseProgram calls, uniform location lookups
+     * and uploads of uniform values that did not change.
+     *
+     * @return - Number of avoided OpenGL calls.
+     */
+    static unsigned long getAvoidedCalls();
+
   private:
+    // Uniform block (std140 layout) backed by a uniform buffer object that is shared by all programs declaring it
+    struct UniformBlock {
+      GLuint buffer;
+      GLuint binding;
+      int users;
+      std::map<std::string, GLint> offsets;
+      std::vector<unsigned char> data;
+    };
+
+    // Active uniform of the program together with the last value uploaded to it
+    struct Uniform {
+      std::string name;
+      GLint location;
+      GLenum type;
+      // Members of uniform blocks are stored in the block buffer instead
+      UniformBlock *block;
+      GLint offset;
+      bool initialized;
+      unsigned char value[sizeof(glm::mat4)];
+    };
+
     GLuint program;
+    mutable std::vector<Uniform> uniforms;
+    std::vector<std::string> blockNames;
+
+    // Program currently bound to the OpenGL state
+    static GLuint current;
+    static unsigned long avoidedCalls;
+
+    // Directory with cached program binaries
+    static std::string binaryCache;
+
+    /*!
+     * Insert preprocessor defines into shader source right after the #version directive.
+     *
+     * @param code - Shader source code.
+     * @param defines - Names to define.
+     * @return - Specialized shader source code.
+     */
+    static std::string specialize(const std::string &code, const std::vector<std::string> &defines);
+
+    /*!
+     * Compile and link GLSL program from source.
+     *
+     * @param vertex_shader_code - String containing the source of the vertex shader.
+     * @param fragment_shader_code - String containing the source of the fragment shader.
+     * @return - OpenGL program identifier number.
+     */
+    static GLuint compile(const std::string &vertex_shader_code, const std::string &fragment_shader_code);
+
+    /*!
+     * Check if program binaries can be retrieved and loaded with the current context.
+     *
+     * @return - true when the binary cache can be used.
+     */
+    static bool binarySupported();
+
+    /*!
+     * Compute the binary cache key from shader sources and the driver identification.
+     *
+     * @param vertex_shader_code - String containing the source of the vertex shader.
+     * @param fragment_shader_code - String containing the source of the fragment shader.
+     * @return - Hash identifying the program binary.
+     */
+    static uint64_t binaryKey(const std::string &vertex_shader_code, const std::string &fragment_shader_code);
+
+    /*!
+     * Get path to the cache file for a program binary.
+     *
+     * @param key - Binary cache key.
+     * @return - File path in the binary cache directory.
+     */
+    static std::string binaryPath(uint64_t key);
+
+    /*!
+     * Create program from a cached binary.
+     *
+     * @param key - Binary cache key.
+     * @return - OpenGL program identifier number, 0 when the binary is missing or invalid.
+     */
+    static GLuint loadBinary(uint64_t key);
+
+    /*!
+     * Store binary of the linked program in the cache.
+     *
+     * @param key - Binary cache key.
+     */
+    void saveBinary(uint64_t key) const;
+
+    /*!
+     * Get the uniform blocks by name.
+     * The table is never destroyed, so static programs released at exit can still return their blocks.
+     *
+     * @return - Uniform blocks shared by all programs.
+     */
+    static std::map<std::string, UniformBlock> &getBlocks();
+
+    /*!
+     * Get the offsets of all members of an active uniform block of the linked program.
+     *
+     * @param index - Index of the active uniform block.
+     * @return - Offsets of the block members by name.
+     */
+    std::map<std::string, GLint> getBlockMembers(GLuint index) const;
+
+    /*!
+     * Collect the active uniforms and uniform blocks of the linked program.
+     * Uniform blocks are bound to their shared uniform buffers.
+     */
+    void loadUniforms();
+
+    /*!
+     * Find uniform in the table of active uniforms.
+     *
+     * @param name - Name of the shader program uniform input variable.
+     * @return - Uniform or nullptr if the program has no such active uniform.
+     */
+    Uniform *findUniform(const std::string &name) const;
+
+    /*!
+     * Store the value for the uniform if it differs from the last upload.
+     * Values of block members are written to the uniform buffer directly.
+     *
+     * @param uniform - Uniform to store the value for, may be nullptr.
+     * @param value - Pointer to the new value.
+     * @param size - Size of the value in bytes.
+     * @return - true when the value needs to be uploaded using glUniform.
+     */
+    bool store(Uniform *uniform, const void *value, size_t size) const;
+
+    /*!
+     * Write value to a uniform block buffer if it differs from the current content.
+     *
+     * @param block - Block to write to.
+     * @param offset - Offset of the member in the block.
+     * @param value - Pointer to the new value.
+     * @param size - Size of the value in bytes.
+     */
+    static void writeBlock(UniformBlock &block, GLint offset, const void *value, size_t size);
+
+    /*!
+     * Write value to the shared uniform block containing the member "name".
+     *
+     * @param name - Name of the uniform block member.
+     * @param value - Pointer to the new value.
+     * @param size - Size of the value in bytes.
+     */
+    static void writeShared(const std::string &name, const void *value, size_t size);
   };
 
 }
-
@@ -3,9 +3,14 @@
 layout(location = 0) in vec3 Position;
 layout(location = 4) in vec3 Color;
 
-// Matrices as program attributes
-uniform mat4 ProjectionMatrix;
-uniform mat4 ViewMatrix;
+// Per-frame camera and light data, shared by all programs through a uniform buffer
+layout(std140) uniform Frame {
+  mat4 ProjectionMatrix;
+  mat4 ViewMatrix;
+  vec3 LightDirection;
+};
+
+// Model matrix as program attribute
 uniform mat4 ModelMatrix;
 
 // Passed to fragment shader
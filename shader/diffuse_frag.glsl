@@ -2,14 +2,22 @@
 // A texture is expected as program attribute
 uniform sampler2D Texture;
 
-// Direction of light
-uniform vec3 LightDirection;
-
-// (optional) Transparency
+// Per-frame camera and light data, shared by all programs through a uniform buffer
+layout(std140) uniform Frame {
+  mat4 ProjectionMatrix;
+  mat4 ViewMatrix;
+  vec3 LightDirection;
+};
+
+#ifdef TRANSPARENCY
+// Transparency, only in the TRANSPARENCY variant
 uniform float Transparency;
+#endif
 
-// (optional) Texture offset
+#ifdef TEXTURE_OFFSET
+// Texture offset, only in the TEXTURE_OFFSET variant
 uniform vec2 TextureOffset;
+#endif
 
 // The vertex shader will feed this input
 in vec2 texCoord;
@@ -26,6 +34,15 @@ void main() {
 
   // Lookup the color in Texture on coordinates given by texCoord
   // NOTE: Texture coordinate is inverted vertically for compatibility with OBJ
-  FragmentColor = texture(Texture, vec2(texCoord.x, 1.0 - texCoord.y) + TextureOffset) * diffuse;
+  vec2 uv = vec2(texCoord.x, 1.0 - texCoord.y);
+#ifdef TEXTURE_OFFSET
+  uv += TextureOffset;
+#endif
+  FragmentColor = texture(Texture, uv) * diffuse;
+
+#ifdef TRANSPARENCY
   FragmentColor.a = Transparency;
+#else
+  FragmentColor.a = 1.0;
+#endif
 }
@@ -2,11 +2,15 @@
 // A texture is expected as program attribute
 uniform sampler2D Texture;
 
-// (optional) Transparency
+#ifdef TRANSPARENCY
+// Transparency, only in the TRANSPARENCY variant
 uniform float Transparency;
+#endif
 
-// (optional) Texture offset
+#ifdef TEXTURE_OFFSET
+// Texture offset, only in the TEXTURE_OFFSET variant
 uniform vec2 TextureOffset;
+#endif
 
 // The vertex shader will feed this input
 in vec2 texCoord;
@@ -17,6 +21,15 @@ out vec4 FragmentColor;
 void main() {
   // Lookup the color in Texture on coordinates given by texCoord
   // NOTE: Texture coordinate is inverted vertically for compatibility with OBJ
-  FragmentColor = texture(Texture, vec2(texCoord.x, 1.0 - texCoord.y) + TextureOffset);
+  vec2 uv = vec2(texCoord.x, 1.0 - texCoord.y);
+#ifdef TEXTURE_OFFSET
+  uv += TextureOffset;
+#endif
+  FragmentColor = texture(Texture, uv);
+
+#ifdef TRANSPARENCY
   FragmentColor.a = Transparency;
+#else
+  FragmentColor.a = 1.0;
+#endif
 }
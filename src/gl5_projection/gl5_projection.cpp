@@ -85,6 +85,9 @@ public:
     // Set texture as program uniform input
     program.setUniform("Texture", texture);
 
+    // Set up projection and view matrix for the initial mode
+    setProjection();
+
     // Quad positions
     // Coordinates in world coordinates
     quad1ModelMatrix = translate(mat4{1.0f}, {0, 0, 1});
@@ -103,6 +106,9 @@ public:
     if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) {
       int next_mode = ((int)mode+1) % (int)Mode::END;
       mode = Mode(next_mode % 8);
+
+      // Set up projection and view matrix only when the mode changes
+      setProjection();
     }
   };
 
@@ -114,9 +120,6 @@ public:
     auto time = glfwGetTime();
     auto rotateMat = rotate(mat4{1.0f}, (float)time, {0, 1, 0});
 
-    // Set up projection and view matrix
-    setProjection();
-
     // Set gray background
     glClearColor(.5f, .5f, .5f, 0);
     // Clear depth and color buffers
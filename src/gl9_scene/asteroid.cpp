@@ -11,9 +11,9 @@ using namespace glm;
 using namespace ppgso;
 
 // Static resources
-unique_ptr<Mesh> Asteroid::mesh;
-unique_ptr<Texture> Asteroid::texture;
-unique_ptr<Shader> Asteroid::shader;
+shared_ptr<Mesh> Asteroid::mesh;
+shared_ptr<Texture> Asteroid::texture;
+shared_ptr<Shader> Asteroid::shader;
 
 Asteroid::Asteroid() {
   // Set random scale speed and rotation
@@ -23,9 +23,9 @@ Asteroid::Asteroid() {
   rotMomentum = ballRand(PI);
 
   // Initialize static resources if needed
-  if (!shader) shader = make_unique<Shader>(diffuse_vert_glsl, diffuse_frag_glsl);
-  if (!texture) texture = make_unique<Texture>(image::loadBMP("asteroid.bmp"));
-  if (!mesh) mesh = make_unique<Mesh>("asteroid.obj");
+  if (!shader) shader = resource::loadShader(diffuse_vert_glsl, diffuse_frag_glsl);
+  if (!texture) texture = resource::loadTexture("asteroid.bmp");
+  if (!mesh) mesh = resource::loadMesh("asteroid.obj");
 }
 
 bool Asteroid::update(Scene &scene, float dt) {
@@ -102,12 +102,7 @@ void Asteroid::explode(Scene &scene, vec3 explosionPosition, vec3 explosionScale
 void Asteroid::render(Scene &scene) {
   shader->use();
 
-  // Set up light
-  shader->setUniform("LightDirection", scene.lightDirection);
-
-  // use camera
-  shader->setUniform("ProjectionMatrix", scene.camera->projectionMatrix);
-  shader->setUniform("ViewMatrix", scene.camera->viewMatrix);
+  // Camera and light are shared through the Frame uniform block set up in Scene::render
 
   // render mesh
   shader->setUniform("ModelMatrix", modelMatrix);
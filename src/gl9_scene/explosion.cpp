@@ -10,9 +10,9 @@ using namespace glm;
 using namespace ppgso;
 
 // static resources
-unique_ptr<Mesh> Explosion::mesh;
-unique_ptr<Texture> Explosion::texture;
-unique_ptr<Shader> Explosion::shader;
+shared_ptr<Mesh> Explosion::mesh;
+shared_ptr<Texture> Explosion::texture;
+shared_ptr<Shader> Explosion::shader;
 
 Explosion::Explosion() {
   // Random rotation and momentum
@@ -21,9 +21,9 @@ Explosion::Explosion() {
   speed = {0.0f, 0.0f, 0.0f};
 
   // Initialize static resources if needed
-  if (!shader) shader = make_unique<Shader>(texture_vert_glsl, texture_frag_glsl);
-  if (!texture) texture = make_unique<Texture>(image::loadBMP("explosion.bmp"));
-  if (!mesh) mesh = make_unique<Mesh>("asteroid.obj");
+  if (!shader) shader = resource::loadShader(texture_vert_glsl, texture_frag_glsl, {"TRANSPARENCY"});
+  if (!texture) texture = resource::loadTexture("explosion.bmp");
+  if (!mesh) mesh = resource::loadMesh("asteroid.obj");
 }
 
 void Explosion::render(Scene &scene) {
@@ -32,10 +32,6 @@ void Explosion::render(Scene &scene) {
   // Transparency, interpolate from 1.0f -> 0.0f
   shader->setUniform("Transparency", 1.0f - age / maxAge);
 
-  // use camera
-  shader->setUniform("ProjectionMatrix", scene.camera->projectionMatrix);
-  shader->setUniform("ViewMatrix", scene.camera->viewMatrix);
-
   // render mesh
   shader->setUniform("ModelMatrix", modelMatrix);
   shader->setUniform("Texture", *texture);
@@ -76,6 +76,14 @@ public:
     glFrontFace(GL_CCW);
     glCullFace(GL_BACK);
 
+    // Start decoding resources of objects that will be spawned during the game
+    // so the first asteroid, missile or explosion does not stall the frame
+    resource::preloadMesh("asteroid.obj");
+    resource::preloadMesh("missile.obj");
+    resource::preloadTexture("asteroid.bmp");
+    resource::preloadTexture("missile.bmp");
+    resource::preloadTexture("explosion.bmp");
+
     initScene();
   }
 
@@ -174,5 +182,8 @@ int main() {
   // Main execution loop
   while (window.pollEvents()) {}
 
+  // Report state changes saved by the shader uniform cache
+  cout << "Avoided OpenGL calls: " << Shader::getAvoidedCalls() << endl;
+
   return EXIT_SUCCESS;
 }
@@ -12,18 +12,18 @@ using namespace glm;
 using namespace ppgso;
 
 // shared resources
-unique_ptr<Mesh> Player::mesh;
-unique_ptr<Texture> Player::texture;
-unique_ptr<Shader> Player::shader;
+shared_ptr<Mesh> Player::mesh;
+shared_ptr<Texture> Player::texture;
+shared_ptr<Shader> Player::shader;
 
 Player::Player() {
   // Scale the default model
   scale *= 3.0f;
 
   // Initialize static resources if needed
-  if (!shader) shader = make_unique<Shader>(diffuse_vert_glsl, diffuse_frag_glsl);
-  if (!texture) texture = make_unique<Texture>(image::loadBMP("corsair.bmp"));
-  if (!mesh) mesh = make_unique<Mesh>("corsair.obj");
+  if (!shader) shader = resource::loadShader(diffuse_vert_glsl, diffuse_frag_glsl);
+  if (!texture) texture = resource::loadTexture("corsair.bmp");
+  if (!mesh) mesh = resource::loadMesh("corsair.obj");
 }
 
 bool Player::update(Scene &scene, float dt) {
@@ -82,12 +82,7 @@ bool Player::update(Scene &scene, float dt) {
 void Player::render(Scene &scene) {
   shader->use();
 
-  // Set up light
-  shader->setUniform("LightDirection", scene.lightDirection);
-
-  // use camera
-  shader->setUniform("ProjectionMatrix", scene.camera->projectionMatrix);
-  shader->setUniform("ViewMatrix", scene.camera->viewMatrix);
+  // Camera and light are shared through the Frame uniform block set up in Scene::render
 
   // render mesh
   shader->setUniform("ModelMatrix", modelMatrix);
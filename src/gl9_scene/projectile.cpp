@@ -10,9 +10,9 @@ using namespace glm;
 using namespace ppgso;
 
 // shared resources
-unique_ptr<Mesh> Projectile::mesh;
-unique_ptr<Shader> Projectile::shader;
-unique_ptr<Texture> Projectile::texture;
+shared_ptr<Mesh> Projectile::mesh;
+shared_ptr<Shader> Projectile::shader;
+shared_ptr<Texture> Projectile::texture;
 
 Projectile::Projectile() {
   // Set default speed
@@ -20,9 +20,9 @@ Projectile::Projectile() {
   rotMomentum = {0.0f, 0.0f, linearRand(-PI/4.0f, PI/4.0f)};
 
   // Initialize static resources if needed
-  if (!shader) shader = make_unique<Shader>(diffuse_vert_glsl, diffuse_frag_glsl);
-  if (!texture) texture = make_unique<Texture>(image::loadBMP("missile.bmp"));
-  if (!mesh) mesh = make_unique<Mesh>("missile.obj");
+  if (!shader) shader = resource::loadShader(diffuse_vert_glsl, diffuse_frag_glsl);
+  if (!texture) texture = resource::loadTexture("missile.bmp");
+  if (!mesh) mesh = resource::loadMesh("missile.obj");
 }
 
 bool Projectile::update(Scene &scene, float dt) {
@@ -46,12 +46,7 @@ bool Projectile::update(Scene &scene, float dt) {
 void Projectile::render(Scene &scene) {
   shader->use();
 
-  // Set up light
-  shader->setUniform("LightDirection", scene.lightDirection);
-
-  // use camera
-  shader->setUniform("ProjectionMatrix", scene.camera->projectionMatrix);
-  shader->setUniform("ViewMatrix", scene.camera->viewMatrix);
+  // Camera and light are shared through the Frame uniform block set up in Scene::render
 
   // render mesh
   shader->setUniform("ModelMatrix", modelMatrix);
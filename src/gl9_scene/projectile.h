@@ -8,9 +8,9 @@
  */
 class Projectile final : public Object {
 private:
-  static std::unique_ptr<ppgso::Shader> shader;
-  static std::unique_ptr<ppgso::Mesh> mesh;
-  static std::unique_ptr<ppgso::Texture> texture;
+  static std::shared_ptr<ppgso::Shader> shader;
+  static std::shared_ptr<ppgso::Mesh> mesh;
+  static std::shared_ptr<ppgso::Texture> texture;
 
   float age{0.0f};
   glm::vec3 speed;
@@ -17,6 +17,11 @@ void Scene::update(float time) {
 }
 
 void Scene::render() {
+  // Camera and light are written once per frame into the uniform block shared by all programs
+  ppgso::Shader::setSharedUniform("ProjectionMatrix", camera->projectionMatrix);
+  ppgso::Shader::setSharedUniform("ViewMatrix", camera->viewMatrix);
+  ppgso::Shader::setSharedUniform("LightDirection", lightDirection);
+
   // Simply render all objects
   for ( auto& obj : objects )
     obj->render(*this);
@@ -10,9 +10,9 @@ using namespace ppgso;
 
 Space::Space() {
   // Initialize static resources if needed
-  if (!shader) shader = make_unique<Shader>(texture_vert_glsl, texture_frag_glsl);
-  if (!texture) texture = make_unique<Texture>(image::loadBMP("stars.bmp"));
-  if (!mesh) mesh = make_unique<Mesh>("quad.obj");
+  if (!shader) shader = resource::loadShader(texture_vert_glsl, texture_frag_glsl, {"TEXTURE_OFFSET"});
+  if (!texture) texture = resource::loadTexture("stars.bmp");
+  if (!mesh) mesh = resource::loadMesh("quad.obj");
 }
 
 bool Space::update(Scene &scene, float dt) {
@@ -40,10 +40,14 @@ void Space::render(Scene &scene) {
   shader->setUniform("Texture", *texture);
   mesh->render();
 
+  // The matrices live in the Frame uniform block shared with other objects, restore the camera
+  Shader::setSharedUniform("ProjectionMatrix", scene.camera->projectionMatrix);
+  Shader::setSharedUniform("ViewMatrix", scene.camera->viewMatrix);
+
   glDepthMask(GL_TRUE);
 }
 
 // shared resources
-unique_ptr<Mesh> Space::mesh;
-unique_ptr<Shader> Space::shader;
-unique_ptr<Texture> Space::texture;
+shared_ptr<Mesh> Space::mesh;
+shared_ptr<Shader> Space::shader;
+shared_ptr<Texture> Space::texture;
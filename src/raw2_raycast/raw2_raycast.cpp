@@ -3,6 +3,11 @@
 // - Casts rays from camera space into scene
 // - Computes collisions with scene geometry
 // - For each collision point calculates lighting
+// - Ray to scene collisions are accelerated using a bounding volume hierarchy (BVH)
+// - Image is rendered in tiles distributed to all cores by a work stealing scheduler
+// - Shadow rays stop at the first blocker and lights are skipped where their attenuated contribution is negligible
+// - The scene is loaded from raw2_raycast.scene or the file given as the first argument
+// - Geometry is templated on the scalar type and rendered in single precision, rays leaving surfaces are offset by error bounds
 
 #include <iostream>
 #include <ppgso/ppgso.h>
@@ -12,22 +17,23 @@ using namespace glm;
 using namespace ppgso;
 
 // Global constants
-const double INF = numeric_limits<double>::max();           // Will be used for infinity
-const double EPS = numeric_limits<double>::epsilon();       // Numerical Epsilon
-const double DELTA = sqrt(EPS);                             // Delta to use
+template<typename T>
+const T INF = numeric_limits<T>::max();                     // Will be used for infinity
+const double LIGHT_CUTOFF = 1.0 / 256;                      // Lights are culled where they contribute less than this
 
 /*!
  * Structure holding origin and direction that represents a ray
  */
+template<typename T>
 struct Ray {
-  dvec3 origin, direction;
+  tvec3<T> origin, direction;
 
   /*!
    * Compute a point on the ray
    * @param t Distance from origin
    * @return Point on ray where t is the distance from the origin
    */
-  inline dvec3 point(double t) const {
+  inline tvec3<T> point(T t) const {
     return origin + direction * t;
   }
 };
@@ -35,30 +41,37 @@ struct Ray {
 /*!
  * Material coefficients for diffuse and emission
  */
+template<typename T>
 struct Material {
-  dvec3 emission, diffuse;
-  double shininess;
+  tvec3<T> emission, diffuse;
+  T shininess;
 };
 
 /*!
  * Structure to represent a ray to object collision, the Hit structure will contain material surface normal
  */
+template<typename T>
 struct Hit {
-  double distance;
-  dvec3 point, normal;
-  Material material;
+  T distance;
+  tvec3<T> point, normal;
+  // Bound of the rounding error of the point, rays leaving the surface are offset by it
+  T error;
+  // Material of the object that was hit, owned by the world
+  const Material<T> *material;
 };
 
 /*!
  * Constant for collisions that have not hit any object in the scene
  */
-const Hit noHit = { INF, {0,0,0}, {0,0,0}, { {0,0,0}, {0,0,0}, 0 } };
+template<typename T>
+const Hit<T> noHit = { INF<T>, {0,0,0}, {0,0,0}, 0, nullptr };
 
 /*!
  * Structure representing a simple camera that is composed on position, up, back and right vectors
  */
+template<typename T>
 struct Camera {
-  dvec3 position, back, up, right;
+  tvec3<T> position, back, up, right;
 
   /*!
  * Generate a new Ray for the given viewport size and position
@@ -66,18 +79,19 @@ struct Camera {
  * @param y Vertical position in the viewport
  * @param width Width of the viewport
  * @param height Height of the viewport
- * @return Ray for the giver viewport position with small random deviation applied to support multi-sampling
+ * @param offset Position inside the pixel in the <0, 1) range, varies between samples to support multi-sampling
+ * @return Ray for the giver viewport position
  */
-  Ray generateRay(int x, int y, int width, int height) const {
+  Ray<T> generateRay(int x, int y, int width, int height, const dvec2 &offset) const {
     // Camera deltas
-    dvec3 vdu = 2.0 * right / (double)width;
-    dvec3 vdv = 2.0 * -up / (double)height;
+    tvec3<T> vdu = T(2) * right / (T)width;
+    tvec3<T> vdv = T(2) * -up / (T)height;
 
-    Ray ray;
+    Ray<T> ray;
     ray.origin = position;
     ray.direction = -back
-                    + vdu * ((double)(-width/2 + x) + linearRand(0.0, 1.0))
-                    + vdv * ((double)(-height/2 + y) + linearRand(0.0, 1.0));
+                    + vdu * ((T)(-width/2 + x) + (T)offset.x)
+                    + vdv * ((T)(-height/2 + y) + (T)offset.y);
     ray.direction = normalize(ray.direction);
     return ray;
   }
@@ -86,93 +100,197 @@ struct Camera {
 /*!
  * Point light represented by color and position
  */
+template<typename T>
 struct Light {
-  dvec3 position, color;
-  double att_const, att_linear, att_quad;
+  tvec3<T> position, color;
+  T att_const, att_linear, att_quad;
+
+  /*!
+   * Compute the distance where the attenuated light drops below LIGHT_CUTOFF
+   * @return Range of the light, 0 for lights that are below the cutoff everywhere or INF for lights that are not attenuated with distance
+   */
+  T range() const {
+    // Solve att_quad * d^2 + att_linear * d + att_const = brightness / LIGHT_CUTOFF
+    T brightness = std::max(std::max(color.r, color.g), color.b);
+    T c = att_const - brightness / (T) LIGHT_CUTOFF;
+    // Already below the cutoff at the light itself
+    if (c >= 0) return 0;
+    if (att_quad > 0) {
+      // With c < 0 the discriminant is positive, the clamps only guard against rounding
+      T discriminant = std::max(att_linear * att_linear - 4 * att_quad * c, T(0));
+      return std::max((-att_linear + sqrt(discriminant)) / (2 * att_quad), T(0));
+    }
+    if (att_linear > 0) return -c / att_linear;
+    return INF<T>;
+  }
 };
 
 /*!
  * Structure representing a sphere which is defined by its center position, radius and material
  */
+template<typename T>
 struct Sphere {
-  double radius;
-  dvec3 center;
-  Material material;
+  T radius;
+  tvec3<T> center;
+  Material<T> material;
 
   /*!
-   * Compute ray to sphere collision
+   * Compute distance of ray to sphere collision
+   * The discriminant uses the distance of closest approach to the center and the roots are computed without cancellation,
+   * so the large wall spheres stay accurate in single precision. Roots within their rounding error from zero are rejected
+   * as they may belong to the surface the ray starts on.
    * @param ray Ray to compute collision against
-   * @return Hit structure that represents the collision or noHit.
+   * @return Distance of the collision or INF
    */
-  inline Hit hit(const Ray &ray) const {
+  inline T distance(const Ray<T> &ray) const {
     auto oc = ray.origin - center;
-    auto a = glm::dot(ray.direction, ray.direction);
+    auto a = dot(ray.direction, ray.direction);
     auto b = dot(oc, ray.direction);
-    auto c = dot(oc, oc) - radius * radius;
-    auto dis = b * b - a * c;
+    auto l = length(oc - b / a * ray.direction);
+    auto dis = a * (radius - l) * (radius + l);
+    if (dis <= 0) return INF<T>;
 
-    if (dis > 0) {
-      auto e = sqrt(dis);
-      auto t = (-b - e) / a;
-
-      if ( t > EPS ) {
-        auto pt = ray.point(t);
-        auto n = normalize(pt - center);
-        return {t, pt, n, material};
-      }
+    auto c = dot(oc, oc) - radius * radius;
+    auto q = -b - copysign(sqrt(dis), b);
+    auto t0 = c / q, t1 = q / a;
+    if (t0 > t1) swap(t0, t1);
 
-      t = (-b + e) / a;
+    auto error = roundingError<T>(8) * (dot(oc, oc) + radius * radius) / abs(q);
+    return t0 > error + roundingError<T>(8) * t0 ? t0 : t1 > error + roundingError<T>(8) * t1 ? t1 : INF<T>;
+  }
 
-      if ( t > EPS ) {
-        auto pt = ray.point(t);
-        auto n = normalize(pt - center);
-        return {t, pt, n, material};
-      }
-    }
-    return noHit;
+  /*!
+   * Compute collision details
+   * @param ray Ray that collided with the sphere
+   * @param t Distance of the collision
+   * @return Hit structure that represents the collision
+   */
+  inline Hit<T> resolve(const Ray<T> &ray, T t) const {
+    // Project the point back onto the sphere so its error does not grow with the distance traveled
+    auto local = ray.point(t) - center;
+    local *= radius / length(local);
+    return {t, center + local, local / radius, roundingError<T>(8) * (radius + length(center)), &material};
   }
 };
 
 /*!
- * Generate a normalized vector that sits on the surface of a half-sphere which is defined using a normal. Used to generate random diffuse reflections.
- * @param normal Normal that defines the dome/half-sphere direction
- * @return Random 3D vector on the dome surface
+ * Structure to represent the scene/world to render
  */
-inline dvec3 RandomDome(const dvec3 &normal) {
-  double d;
-  dvec3 p;
+template<typename T>
+struct World {
+  Camera<T> camera;
+  vector<Light<T>> lights;
+  vector<Sphere<T>> spheres;
+  BVH bvh{};
+  // Hierarchy over the ranges of the attenuated lights, finds the lights that reach a point
+  BVH lightBvh{};
+  // Indices and ranges of the lights in lightBvh
+  vector<uint32_t> rangedLights{};
+  vector<T> lightRanges{};
+  // Indices of the lights that reach everywhere
+  vector<uint32_t> globalLights{};
 
-  do {
-    p = sphericalRand(1.0);
-    d = dot(p, normal);
-  } while(d < 0);
+  /*!
+   * Create world from a scene file, only spheres are rendered so mesh instances and blobs are skipped
+   * @param scene Loaded scene file
+   * @return World with the camera, lights and spheres of the scene, build needs to be called before rendering
+   */
+  static World load(const SceneFile &scene) {
+    World world{};
+    auto &camera = scene.camera;
+    world.camera = {tvec3<T>{camera.position}, tvec3<T>{camera.back}, tvec3<T>{camera.up}, tvec3<T>{camera.right}};
+
+    for (auto &light : scene.lights)
+      world.lights.push_back({tvec3<T>{light.position}, tvec3<T>{light.color}, (T) light.constant, (T) light.linear, (T) light.quadratic});
+
+    for (auto &sphere : scene.spheres) {
+      auto &material = scene.materials[sphere.material];
+      world.spheres.push_back({(T) sphere.radius, tvec3<T>{sphere.center},
+                               {tvec3<T>{material.emission}, tvec3<T>{material.diffuse}, (T) material.shininess}});
+    }
 
-  return p;
-}
+    if (!scene.instances.empty() || !scene.blobs.empty())
+      cerr << "Skipping " << scene.instances.size() << " mesh instances and " << scene.blobs.size()
+           << " blobs, only spheres are supported" << endl;
+    return world;
+  }
 
-/*!
- * Structure to represent the scene/world to render
- */
-struct World {
-  Camera camera;
-  vector<Light> lights;
-  vector<Sphere> spheres;
+  /*!
+   * Build the bounding volume hierarchies over all spheres and lights, needs to be called after the scene changes
+   */
+  void build() {
+    vector<BVH::Box> boxes;
+    boxes.reserve(spheres.size());
+    for (auto &sphere : spheres)
+      boxes.push_back(BVH::Box::bounds(sphere.center - sphere.radius, sphere.center + sphere.radius));
+    bvh.build(boxes);
+
+    // Lights with a limited range go to the hierarchy, the rest is always evaluated
+    rangedLights.clear();
+    lightRanges.clear();
+    globalLights.clear();
+    boxes.clear();
+    for (uint32_t i = 0; i < lights.size(); i++) {
+      auto range = lights[i].range();
+      if (range == INF<T>) {
+        globalLights.push_back(i);
+        continue;
+      }
+      // Lights that never reach the cutoff are dropped, this also keeps invalid ranges out of the hierarchy
+      if (!(range > 0)) continue;
+      rangedLights.push_back(i);
+      lightRanges.push_back(range);
+      boxes.push_back(BVH::Box::bounds(lights[i].position - range, lights[i].position + range));
+    }
+    lightBvh.build(boxes);
+  }
 
   /*!
    * Compute ray to object collision with any object in the world
    * @param ray Ray to trace collisions for
    * @return Hit or noHit structure which indicates the material and distance the ray has collided with
    */
-  inline Hit cast(const Ray &ray) const {
-    auto hit = noHit;
-    for ( auto& sphere : spheres) {
-      auto lh = sphere.hit(ray);
-
-      if (lh.distance < hit.distance) {
-        hit = lh;
+  inline Hit<T> cast(const Ray<T> &ray) const {
+    // Only the distance and index of the closest sphere are tracked, the details are resolved once at the end
+    auto closest = spheres.size();
+    auto tmax = INF<T>;
+    bvh.closest(ray.origin, ray.direction, tmax, [&](uint32_t index, T &t) {
+      auto distance = spheres[index].distance(ray);
+
+      if (distance < t) {
+        closest = index;
+        t = distance;
       }
-    }
-    return hit;
+    });
+    return closest < spheres.size() ? spheres[closest].resolve(ray, tmax) : noHit<T>;
+  }
+
+  /*!
+   * Check whether any object blocks the ray, the traversal stops at the first collision found
+   * @param ray Ray to check
+   * @param distance Only collisions closer than this distance are considered
+   * @return True if the ray is blocked
+   */
+  inline bool occluded(const Ray<T> &ray, T distance) const {
+    return bvh.any(ray.origin, ray.direction, distance, [&](uint32_t index, T t) {
+      return spheres[index].distance(ray) < t;
+    });
+  }
+
+  /*!
+   * Visit all lights that may contribute to a point
+   * @param point Point to light
+   * @param visit Callback void(const Light<T> &light)
+   */
+  template<typename Visit>
+  inline void visitLights(const tvec3<T> &point, Visit visit) const {
+    lightBvh.contains(point, [&](uint32_t index) {
+      // The box of the range is larger than the range itself
+      auto &light = lights[rangedLights[index]];
+      if (distance(light.position, point) < lightRanges[index]) visit(light);
+    });
+    for (auto index : globalLights)
+      visit(lights[index]);
   }
 
   /*!
@@ -181,35 +299,34 @@ struct World {
    * @param depth Maximum number of collisions to trace
    * @return Color representing the accumulated lighting for earch ray collision
    */
-  inline dvec3 trace(const Ray &ray) const {
-    Hit hit = cast(ray);
+  inline tvec3<T> trace(const Ray<T> &ray) const {
+    Hit<T> hit = cast(ray);
 
     // No hit
-    if (hit.distance >= INF) return {0, 0, 0};
+    if (hit.distance >= INF<T>) return {0, 0, 0};
 
     // Phong components
-    dvec3 ambientColor = {0.1, 0.1, 0.1};
-    dvec3 emissionColor = hit.material.emission;
-    dvec3 diffuseColor = {0,0,0};
-    dvec3 specularColor = {0,0,0};
-    for( auto& light : lights) {
+    tvec3<T> ambientColor = {0.1, 0.1, 0.1};
+    tvec3<T> emissionColor = hit.material->emission;
+    tvec3<T> diffuseColor = {0,0,0};
+    tvec3<T> specularColor = {0,0,0};
+    visitLights(hit.point, [&](const Light<T> &light) {
       auto lightDirection = light.position - hit.point;
       auto lightDistance = length(lightDirection);
       auto lightNormal = normalize(lightDirection);
-      Ray lightRay = {hit.point + hit.normal * DELTA, lightNormal};
+      Ray<T> lightRay = {offsetOrigin(hit.point, hit.normal, hit.error), lightNormal};
 
       // Light is obscured by object
-      auto shadowTest = cast(lightRay);
-      if(shadowTest.distance < lightDistance ) continue;
+      if (occluded(lightRay, lightDistance)) return;
 
       // Light is visible
-      auto att_factor = 1.0 / (light.att_const + light.att_linear * lightDistance + light.att_quad * lightDistance * lightDistance);
-      auto dif = glm::clamp(dot(lightRay.direction, hit.normal), 0.0, 1.0);
-      diffuseColor += hit.material.diffuse * att_factor * light.color * dif;
+      auto att_factor = T(1) / (light.att_const + light.att_linear * lightDistance + light.att_quad * lightDistance * lightDistance);
+      auto dif = glm::clamp(dot(lightRay.direction, hit.normal), T(0), T(1));
+      diffuseColor += hit.material->diffuse * att_factor * light.color * dif;
 
-      auto spec = glm::clamp(dot(reflect(ray.direction, hit.normal), lightRay.direction), 0.0, 1.0);
-      specularColor += light.color * att_factor * pow(spec, hit.material.shininess);
-    }
+      auto spec = glm::clamp(dot(reflect(ray.direction, hit.normal), lightRay.direction), T(0), T(1));
+      specularColor += light.color * att_factor * pow(spec, hit.material->shininess);
+    });
 
     // Additive lighting result
     return ambientColor + emissionColor + diffuseColor + specularColor;
@@ -220,50 +337,39 @@ struct World {
    * @param image Image to render to
    */
   void render(Image& image, unsigned int samples) const {
-    // Render section of the framebuffer
-    for(int y = 0; y < image.height; ++y) {
-      for (int x = 0; x < image.width; ++x) {
-        dvec3 color{};
-        for (unsigned int i = 0; i < samples; i++) {
-          auto ray = camera.generateRay(x, y, image.width, image.height);
-          color = color + trace(ray);
+    // Render tiles of the framebuffer on all cores
+    TileScheduler scheduler{image.width, image.height};
+    scheduler.run([&](const Tile &tile, unsigned) {
+      for (int y = tile.y; y < tile.y + tile.height; ++y) {
+        for (int x = tile.x; x < tile.x + tile.width; ++x) {
+          tvec3<T> color{};
+          for (unsigned int i = 0; i < samples; i++) {
+            Sampler sampler{(uint32_t) (y * image.width + x), i};
+            auto ray = camera.generateRay(x, y, image.width, image.height, sampler.next2D());
+            color = color + trace(ray);
+          }
+          color = color / (T) samples;
+          image.setPixel(x, y, (float) color.r, (float) color.g, (float) color.b);
         }
-        color = color / (double) samples;
-        image.setPixel(x, y, (float) color.r, (float) color.g, (float) color.b);
       }
-    }
+    });
   }
 };
 
-int main() {
+int main(int argc, char *argv[]) {
+  if (argc > 2) {
+    cerr << "Usage: " << argv[0] << " [file.scene]" << endl;
+    return EXIT_FAILURE;
+  }
+
   // Image to render to
   Image image {512, 512};
 
   // World to render
-  const World world = {
-      { // Camera
-          {  0,   0, 25}, // pos
-          {  0,   0,  1}, // back
-          {  0,  .5,  0}, // up
-          { .5,   0,  0}, // right
-      },
-      { // Lights
-          { {-5, 5, 9}, {1, 1, 1}, 1, .1, 0 },
-          { { 5, 0, 15}, {0.2, 0.5, 0.2}, 1, .1, .01 },
-      },
-      { // Spheres
-          { 10000, {  0, -10010, 0}, { {0, 0, 0}, {.8, .8, .8}, 1 } },
-          { 10000, { -10010, 0, 0}, { { 0, 0, 0}, { 1, 0, 0}, 1 } },
-          { 10000, {  10010, 0, 0}, { { 0, 0, 0}, { 0, 1, 0}, 1 } },
-          { 10000, {  0,0, -10010}, { { 0, 0, 0}, { .8, .8, 0}, 1 } },
-          { 10000, {  0,10010, 0}, { { .3, .3, .3}, { .8, .8, .8}, 1 } },
-          {     2, { -5,  -8,  3}, { { 0, 0, 0}, { .7, .7, 0}, 3 } },
-          {     4, {  0,  -6,  0}, { { 0, 0, 0}, { .7, .5, .1}, 5 } },
-          {    10, {  10, 10, -10}, { { 0, 0, 0}, { 0, 0, 1}, 30 } },
-      },
-  };
-
-  // Render the scene
+  auto world = World<float>::load(SceneFile{argc > 1 ? argv[1] : "raw2_raycast.scene"});
+
+  // Build the acceleration structure and render the scene
+  world.build();
   world.render(image, 4);
 
   // Save the result
@@ -1,9 +1,33 @@
 // Example raw3_raytrace
-// - Simple demonstration of raytracing/pathtracing without any acceleration techniques
+// - Simple demonstration of raytracing/pathtracing
 // - Casts rays from camera space into scene and recursively traces reflections/refractions
 // - Materials are extended to support simple specular reflections and transparency with refraction index
+// - Ray to scene collisions are accelerated using a bounding volume hierarchy (BVH)
+// - The scene is loaded from raw3_raytrace.scene or the file given by --scene, mesh instances are
+//   flattened into separate triangles
+// - Triangle meshes can be loaded from Wavefront obj files using --mesh file.obj
+// - Blobs are signed distance fields of noise displaced spheres combined by CSG, sphere traced with their Lipschitz bound
+// - Image is rendered in tiles distributed to all cores by a work stealing scheduler
+// - Samples are generated from a scrambled Sobol sequence and diffuse reflections follow the cosine distribution
+// - Samples are accumulated progressively until the sample count, --time budget or --noise target is reached
+// - With --adaptive only pixels with relative error above the threshold receive more samples
+// - Paths are traced iteratively with Russian roulette and direct sampling of the emissive spheres
+// - With --wavefront all paths of a tile advance together one bounce at a time, sorted by material and direction
+// - With --denoise the result is also filtered by an edge avoiding wavelet filter guided by the first collisions
+// - Geometry uses single precision by default, --double switches to double precision, rays leaving surfaces are offset by error bounds
+// - Primary rays of neighbouring pixels are traced in packets, use --scalar to trace them one by one
+// - With --processes or --listen tiles are rendered by worker processes started locally or connected with --worker host:port,
+//   --listen accepts only workers on the same machine unless an address such as 0.0.0.0:port is given
+// - With --frames the keyframes of the scene file are rendered as a sequence, moving objects only refit the BVH
+// - With --reproject each frame of a sequence starts from the samples of the previous frame where they stay valid
+// - Run with --benchmark to measure ray throughput with growing number of spheres
 
 #include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <sstream>
+#include <numeric>
+#include <deque>
 #include <ppgso/ppgso.h>
 
 using namespace std;
@@ -12,21 +36,46 @@ using namespace ppgso;
 
 // Global constants
 constexpr double INF = numeric_limits<double>::max();       // Will be used for infinity
-constexpr double EPS = numeric_limits<double>::epsilon();   // Numerical epsilon
-const double DELTA = sqrt(EPS);                             // Delta to use
+template<typename T>
+const T MAX_DISTANCE = numeric_limits<T>::max();            // Distance of rays that did not hit anything
+
+// Primary rays of neighbouring pixels are traced together in packets, 8 lanes fill an AVX register, 4 lanes fill SSE
+#ifdef __AVX__
+constexpr int PACKET_WIDTH = 4;
+#else
+constexpr int PACKET_WIDTH = 2;
+#endif
+constexpr int PACKET_HEIGHT = 2;
+constexpr int PACKET_SIZE = PACKET_WIDTH * PACKET_HEIGHT;
+constexpr unsigned int ROULETTE_BOUNCES = 2;                // Bounces before paths may be terminated by Russian roulette
+constexpr unsigned int ADAPTIVE_MIN_SAMPLES = 8;            // Samples taken before the pixel error is trusted
+constexpr float PACKET_EPS = 1e-4f;                         // Packets use single precision and need a larger epsilon
+constexpr float PACKET_TOLERANCE = 1e-5f;                   // Enlarge triangles so packets never miss shared edges
+constexpr float PACKET_INF = numeric_limits<float>::infinity();
+constexpr uint32_t NO_PRIMITIVE = numeric_limits<uint32_t>::max();  // Primitive index of rays that did not hit anything
+constexpr size_t SPHERE_BATCH = 64;                         // Spheres tested together in SIMD lanes without the BVH
+constexpr int BLOB_OCTAVES = 4;                             // Octaves of the noise displacing blobs
+constexpr int BLOB_STEPS = 256;                             // Sphere tracing steps before a ray is considered to miss a blob
+constexpr double BLOB_PRECISION = 1e-4;                     // Distance to the surface of a blob counted as a hit, relative to its radius
+constexpr float REFIT_LIMIT = 1.5f;                         // Relative growth of the BVH cost after which refitting gives way to a rebuild
+constexpr float REPROJECT_DEPTH = 0.02f;                    // Relative depth difference tolerated when reusing previous samples
+constexpr float REPROJECT_NORMAL = 0.9f;                    // Cosine between normals required when reusing previous samples
+constexpr uint32_t WORKER_MAGIC = 0x72337730;               // Sent by workers first, changes with the protocol
+using Packet = BVH::Packet<PACKET_SIZE>;
 
 /*!
  * Structure holding origin and direction that represents a ray
  */
+template<typename T>
 struct Ray {
-  dvec3 origin, direction;
+  tvec3<T> origin, direction;
 
   /*!
    * Compute a point on the ray
    * @param t Distance from origin
    * @return Point on ray where t is the distance from the origin
    */
-  inline dvec3 point(double t) const {
+  inline tvec3<T> point(T t) const {
     return origin + direction * t;
   }
 };
@@ -34,31 +83,38 @@ struct Ray {
 /*!
  * Material coefficients for diffuse and emission
  */
+template<typename T>
 struct Material {
-  dvec3 emission, diffuse;
-  double reflectivity;
-  double transparency, refractionIndex;
+  tvec3<T> emission, diffuse;
+  T reflectivity;
+  T transparency, refractionIndex;
 };
 
 /*!
  * Structure to represent a ray to object collision, the Hit structure will contain material surface normal
  */
+template<typename T>
 struct Hit {
-  double distance;
-  dvec3 point, normal;
-  Material material;
+  T distance;
+  tvec3<T> point, normal;
+  // Bound of the rounding error of the point, rays leaving the surface are offset by it
+  T error;
+  // Material of the primitive that was hit, owned by the world
+  const Material<T> *material;
 };
 
 /*!
  * Constant for collisions that have not hit any object in the scene
  */
-const Hit noHit{ INF, {0,0,0}, {0,0,0}, { {0,0,0}, {0,0,0}, 0, 0, 0 } };
+template<typename T>
+const Hit<T> noHit{ MAX_DISTANCE<T>, {0,0,0}, {0,0,0}, 0, nullptr };
 
 /*!
  * Structure representing a simple camera that is composed on position, up, back and right vectors
  */
+template<typename T>
 struct Camera {
-  dvec3 position, back, up, right;
+  tvec3<T> position, back, up, right;
 
   /*!
    * Generate a new Ray for the given viewport size and position
@@ -66,18 +122,19 @@ struct Camera {
    * @param y Vertical position in the viewport
    * @param width Width of the viewport
    * @param height Height of the viewport
-   * @return Ray for the giver viewport position with small random deviation applied to support multi-sampling
+   * @param offset Position inside the pixel in the <0, 1) range, varies between samples to support multi-sampling
+   * @return Ray for the giver viewport position
    */
-  Ray generateRay(int x, int y, int width, int height) const {
+  Ray<T> generateRay(int x, int y, int width, int height, const dvec2 &offset) const {
     // Camera deltas
-    dvec3 vdu = 2.0 * right / (double)width;
-    dvec3 vdv = 2.0 * -up / (double)height;
+    tvec3<T> vdu = T(2) * right / (T)width;
+    tvec3<T> vdv = T(2) * -up / (T)height;
 
-    Ray ray;
+    Ray<T> ray;
     ray.origin = position;
     ray.direction = -back
-                  + vdu * ((double)(-width/2 + x) + linearRand(0.0, 1.0))
-                  + vdv * ((double)(-height/2 + y) + linearRand(0.0, 1.0));
+                  + vdu * ((T)(-width/2 + x) + (T)offset.x)
+                  + vdv * ((T)(-height/2 + y) + (T)offset.y);
     ray.direction = normalize(ray.direction);
     return ray;
   }
@@ -86,191 +143,2030 @@ struct Camera {
 /*!
  * Structure representing a sphere which is defined by its center position, radius and material
  */
+template<typename T>
 struct Sphere {
-  double radius;
-  dvec3 center;
-  Material material;
+  T radius;
+  tvec3<T> center;
+  Material<T> material;
+};
+
+/*!
+ * Spheres of the world stored as a structure of arrays, so collisions of a ray with many spheres can be tested in SIMD lanes
+ * Ray traversal only computes distances, the collision details are resolved once for the closest sphere
+ */
+template<typename T>
+struct Spheres {
+  vector<T> x, y, z, radius;
+  vector<Material<T>> materials;
+
+  /*!
+   * Number of spheres
+   * @return Number of spheres stored
+   */
+  inline size_t size() const {
+    return radius.size();
+  }
+
+  /*!
+   * Remove all spheres
+   */
+  void clear() {
+    x.clear(); y.clear(); z.clear();
+    radius.clear();
+    materials.clear();
+  }
 
   /*!
-   * Compute ray to sphere collision
+   * Add sphere
+   * @param sphere Sphere to add
+   */
+  void add(const Sphere<T> &sphere) {
+    x.push_back(sphere.center.x); y.push_back(sphere.center.y); z.push_back(sphere.center.z);
+    radius.push_back(sphere.radius);
+    materials.push_back(sphere.material);
+  }
+
+  /*!
+   * Compute distance of ray to sphere collision
+   * The discriminant uses the distance of closest approach to the center and the roots are computed without cancellation,
+   * so the large wall spheres stay accurate in single precision. Roots within their rounding error from zero are rejected
+   * as they may belong to the surface the ray starts on. The test has no branches so it vectorizes across spheres.
+   * @param ocx Horizontal position of the ray origin relative to the sphere center
+   * @param ocy Vertical position of the ray origin relative to the sphere center
+   * @param ocz Depth position of the ray origin relative to the sphere center
+   * @param direction Ray direction
+   * @param r Sphere radius
+   * @return Distance of the collision or MAX_DISTANCE
+   */
+  static inline T distance(T ocx, T ocy, T ocz, const tvec3<T> &direction, T r) {
+    T a = dot(direction, direction);
+    T b = ocx * direction.x + ocy * direction.y + ocz * direction.z;
+    T lx = ocx - b / a * direction.x, ly = ocy - b / a * direction.y, lz = ocz - b / a * direction.z;
+    T l = sqrt(lx * lx + ly * ly + lz * lz);
+    T dis = a * (r - l) * (r + l);
+
+    T oc = ocx * ocx + ocy * ocy + ocz * ocz;
+    T c = oc - r * r;
+    T q = -b - copysign(sqrt(std::max(dis, T(0))), b);
+    T t0 = std::min(c / q, q / a), t1 = std::max(c / q, q / a);
+
+    T error = roundingError<T>(8) * (oc + r * r) / abs(q);
+    T t = t0 > error + roundingError<T>(8) * t0 ? t0 : t1 > error + roundingError<T>(8) * t1 ? t1 : MAX_DISTANCE<T>;
+    return dis > 0 ? t : MAX_DISTANCE<T>;
+  }
+
+  /*!
+   * Compute distance of ray to sphere collision
+   * @param i Sphere index
    * @param ray Ray to compute collision against
-   * @return Hit structure that represents the collision or noHit.
-   */
-  inline Hit hit(const Ray &ray) const {
-    dvec3 oc = ray.origin - center;
-    double a = dot(ray.direction, ray.direction);
-    double b = dot(oc, ray.direction);
-    double c = dot(oc, oc) - radius * radius;
-    double dis = b * b - a * c;
-
-    if (dis > 0) {
-      double e = sqrt(dis);
-      double t = (-b - e) / a;
-
-      if ( t > EPS ) {
-        dvec3 pt = ray.point(t);
-        dvec3 n = normalize(pt - center);
-        return {t, pt, n, material};
+   * @return Distance of the collision or MAX_DISTANCE
+   */
+  inline T distance(size_t i, const Ray<T> &ray) const {
+    return distance(ray.origin.x - x[i], ray.origin.y - y[i], ray.origin.z - z[i], ray.direction, radius[i]);
+  }
+
+  /*!
+   * Compute distances of ray collisions with a range of spheres in SIMD lanes
+   * @param ray Ray to compute collisions against
+   * @param first Index of the first sphere
+   * @param count Number of spheres to test
+   * @param t Output distance of the collision for each sphere or MAX_DISTANCE
+   */
+  inline void distances(const Ray<T> &ray, size_t first, size_t count, T *t) const {
+    const T *px = x.data() + first, *py = y.data() + first, *pz = z.data() + first, *pr = radius.data() + first;
+    #pragma omp simd
+    for (size_t i = 0; i < count; i++)
+      t[i] = distance(ray.origin.x - px[i], ray.origin.y - py[i], ray.origin.z - pz[i], ray.direction, pr[i]);
+  }
+
+  /*!
+   * Compute collision details for a sphere
+   * @param i Sphere index
+   * @param ray Ray that collided with the sphere
+   * @param t Distance of the collision
+   * @return Hit structure that represents the collision
+   */
+  inline Hit<T> resolve(size_t i, const Ray<T> &ray, T t) const {
+    tvec3<T> center{x[i], y[i], z[i]};
+    // Project the point back onto the sphere so its error does not grow with the distance traveled
+    tvec3<T> local = ray.point(t) - center;
+    local *= radius[i] / length(local);
+    return {t, center + local, local / radius[i], roundingError<T>(8) * (radius[i] + length(center)), &materials[i]};
+  }
+
+  /*!
+   * Compute distances of collisions for all rays in a packet in single precision
+   * Uses the distance of closest approach to the center to limit cancellation for the large wall spheres
+   * @param i Sphere index
+   * @param packet Rays to compute collisions against
+   * @param t Output distance of the collision for each lane or infinity
+   */
+  inline void hit(size_t i, const Packet &packet, float (&t)[PACKET_SIZE]) const {
+    vec3 c{x[i], y[i], z[i]};
+    auto r = (float) radius[i];
+    #pragma omp simd
+    for (int j = 0; j < PACKET_SIZE; j++) {
+      float ocx = packet.ox[j] - c.x, ocy = packet.oy[j] - c.y, ocz = packet.oz[j] - c.z;
+      float a = packet.dx[j] * packet.dx[j] + packet.dy[j] * packet.dy[j] + packet.dz[j] * packet.dz[j];
+      float b = ocx * packet.dx[j] + ocy * packet.dy[j] + ocz * packet.dz[j];
+      float lx = ocx - b / a * packet.dx[j], ly = ocy - b / a * packet.dy[j], lz = ocz - b / a * packet.dz[j];
+      float l = std::sqrt(lx * lx + ly * ly + lz * lz);
+      float dis = a * (r - l) * (r + l);
+      float e = std::sqrt(std::max(dis, 0.0f));
+      float t0 = (-b - e) / a, t1 = (-b + e) / a;
+      t[j] = dis <= 0 ? PACKET_INF : t0 > PACKET_EPS ? t0 : t1 > PACKET_EPS ? t1 : PACKET_INF;
+    }
+  }
+};
+
+/*!
+ * Triangles of all meshes in the world stored as a structure of arrays in single precision to keep them compact
+ * Each triangle references a material shared with other triangles of the same mesh
+ */
+template<typename T>
+struct Triangles {
+  // Vertex positions, one entry per triangle
+  vector<float> ax, ay, az;
+  vector<float> bx, by, bz;
+  vector<float> cx, cy, cz;
+  vector<uint32_t> material;
+  vector<Material<T>> materials;
+
+  /*!
+   * Ray dependent data for the watertight ray to triangle test, computed once per ray
+   */
+  struct Shear {
+    int kx, ky, kz;
+    T sx, sy, sz;
+  };
+
+  /*!
+   * Number of triangles
+   * @return Number of triangles stored
+   */
+  inline size_t size() const {
+    return material.size();
+  }
+
+  /*!
+   * Reserve space for triangles
+   * @param count Number of triangles
+   */
+  void reserve(size_t count) {
+    for (auto coordinate : {&ax, &ay, &az, &bx, &by, &bz, &cx, &cy, &cz})
+      coordinate->reserve(coordinate->size() + count);
+    material.reserve(material.size() + count);
+  }
+
+  /*!
+   * Add triangle
+   * @param a First vertex
+   * @param b Second vertex
+   * @param c Third vertex, vertices are expected in counter clockwise order when seen from the outside
+   * @param materialIndex Index into materials
+   */
+  void add(const vec3 &a, const vec3 &b, const vec3 &c, uint32_t materialIndex) {
+    ax.push_back(a.x); ay.push_back(a.y); az.push_back(a.z);
+    bx.push_back(b.x); by.push_back(b.y); bz.push_back(b.z);
+    cx.push_back(c.x); cy.push_back(c.y); cz.push_back(c.z);
+    material.push_back(materialIndex);
+  }
+
+  /*!
+   * Move triangle
+   * @param i Triangle index
+   * @param a First vertex
+   * @param b Second vertex
+   * @param c Third vertex
+   */
+  void set(size_t i, const vec3 &a, const vec3 &b, const vec3 &c) {
+    ax[i] = a.x; ay[i] = a.y; az[i] = a.z;
+    bx[i] = b.x; by[i] = b.y; bz[i] = b.z;
+    cx[i] = c.x; cy[i] = c.y; cz[i] = c.z;
+  }
+
+  /*!
+   * Get triangle vertices
+   * @param i Triangle index
+   * @param a First vertex
+   * @param b Second vertex
+   * @param c Third vertex
+   */
+  inline void vertices(size_t i, tvec3<T> &a, tvec3<T> &b, tvec3<T> &c) const {
+    a = {ax[i], ay[i], az[i]};
+    b = {bx[i], by[i], bz[i]};
+    c = {cx[i], cy[i], cz[i]};
+  }
+
+  /*!
+   * Compute bounding box of a triangle
+   * @param i Triangle index
+   * @return Bounding box containing the triangle
+   */
+  BVH::Box bounds(size_t i) const {
+    BVH::Box box;
+    box.extend(vec3{ax[i], ay[i], az[i]});
+    box.extend(vec3{bx[i], by[i], bz[i]});
+    box.extend(vec3{cx[i], cy[i], cz[i]});
+    return box;
+  }
+
+  /*!
+   * Prepare shear transformation that maps the ray direction to the z axis
+   * @param ray Ray to prepare
+   * @return Shear constants for the watertight test
+   */
+  static Shear shear(const Ray<T> &ray) {
+    Shear shear;
+    auto d = abs(ray.direction);
+    shear.kz = d.x > d.y ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+    shear.kx = (shear.kz + 1) % 3;
+    shear.ky = (shear.kx + 1) % 3;
+    // Keep the winding direction of the triangles
+    if (ray.direction[shear.kz] < 0) swap(shear.kx, shear.ky);
+    shear.sx = ray.direction[shear.kx] / ray.direction[shear.kz];
+    shear.sy = ray.direction[shear.ky] / ray.direction[shear.kz];
+    shear.sz = T(1) / ray.direction[shear.kz];
+    return shear;
+  }
+
+  /*!
+   * Compute ray to triangle collision using the watertight test by Woop, Benthin and Wald,
+   * rays never slip through shared edges or vertices of neighbouring triangles
+   * Distances within the rounding error bound of the test are rejected as they may belong to the surface the ray starts on
+   * @param i Triangle index
+   * @param ray Ray to compute collision against
+   * @param shear Shear constants for the ray
+   * @return Distance of the collision or MAX_DISTANCE
+   */
+  inline T hit(size_t i, const Ray<T> &ray, const Shear &shear) const {
+    tvec3<T> a, b, c;
+    vertices(i, a, b, c);
+    a -= ray.origin;
+    b -= ray.origin;
+    c -= ray.origin;
+
+    // Shear and scale the vertices so the ray points along z
+    T ax = a[shear.kx] - shear.sx * a[shear.kz];
+    T ay = a[shear.ky] - shear.sy * a[shear.kz];
+    T bx = b[shear.kx] - shear.sx * b[shear.kz];
+    T by = b[shear.ky] - shear.sy * b[shear.kz];
+    T cx = c[shear.kx] - shear.sx * c[shear.kz];
+    T cy = c[shear.ky] - shear.sy * c[shear.kz];
+
+    // Scaled barycentric coordinates, all must have the same sign
+    T u = cx * by - cy * bx;
+    T v = ax * cy - ay * cx;
+    T w = bx * ay - by * ax;
+    if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0)) return MAX_DISTANCE<T>;
+
+    T det = u + v + w;
+    if (det == 0) return MAX_DISTANCE<T>;
+
+    T az = shear.sz * a[shear.kz], bz = shear.sz * b[shear.kz], cz = shear.sz * c[shear.kz];
+    T t = (u * az + v * bz + w * cz) / det;
+
+    // Error bound of the distance (M. Pharr et al., Physically Based Rendering, 3rd edition, chapter 3.9.6)
+    T maxX = std::max(std::max(abs(ax), abs(bx)), abs(cx));
+    T maxY = std::max(std::max(abs(ay), abs(by)), abs(cy));
+    T maxZ = std::max(std::max(abs(az), abs(bz)), abs(cz));
+    T maxE = std::max(std::max(abs(u), abs(v)), abs(w));
+    T deltaX = roundingError<T>(5) * (maxX + maxZ);
+    T deltaY = roundingError<T>(5) * (maxY + maxZ);
+    T deltaZ = roundingError<T>(3) * maxZ;
+    T deltaE = 2 * (roundingError<T>(7) * maxX * maxY + deltaY * maxX + deltaX * maxY);
+    T deltaT = 3 * (roundingError<T>(3) * maxE * maxZ + deltaE * maxZ + deltaZ * maxE) / abs(det);
+    return t > deltaT ? t : MAX_DISTANCE<T>;
+  }
+
+  /*!
+   * Compute distances of collisions with a triangle for all rays in a packet using the Moller-Trumbore test in single precision
+   * The triangle is slightly enlarged so the test errs on the side of a hit, the closest hit is then confirmed by the watertight test
+   * @param i Triangle index
+   * @param packet Rays to compute collisions against
+   * @param t Output distance of the collision for each lane or infinity
+   */
+  inline void hit(size_t i, const Packet &packet, float (&t)[PACKET_SIZE]) const {
+    float e1x = bx[i] - ax[i], e1y = by[i] - ay[i], e1z = bz[i] - az[i];
+    float e2x = cx[i] - ax[i], e2y = cy[i] - ay[i], e2z = cz[i] - az[i];
+    #pragma omp simd
+    for (int j = 0; j < PACKET_SIZE; j++) {
+      float px = packet.dy[j] * e2z - packet.dz[j] * e2y;
+      float py = packet.dz[j] * e2x - packet.dx[j] * e2z;
+      float pz = packet.dx[j] * e2y - packet.dy[j] * e2x;
+      float det = e1x * px + e1y * py + e1z * pz;
+      float inverse = 1.0f / det;
+      float sx = packet.ox[j] - ax[i], sy = packet.oy[j] - ay[i], sz = packet.oz[j] - az[i];
+      float u = (sx * px + sy * py + sz * pz) * inverse;
+      float qx = sy * e1z - sz * e1y;
+      float qy = sz * e1x - sx * e1z;
+      float qz = sx * e1y - sy * e1x;
+      float v = (packet.dx[j] * qx + packet.dy[j] * qy + packet.dz[j] * qz) * inverse;
+      float distance = (e2x * qx + e2y * qy + e2z * qz) * inverse;
+      bool inside = det != 0 && u >= -PACKET_TOLERANCE && v >= -PACKET_TOLERANCE && u + v <= 1 + PACKET_TOLERANCE;
+      t[j] = inside && distance > PACKET_EPS ? distance : PACKET_INF;
+    }
+  }
+
+  /*!
+   * Compute collision details for a triangle
+   * @param i Triangle index
+   * @param ray Ray that collided with the triangle
+   * @param t Distance of the collision
+   * @return Hit structure with geometric normal of the triangle
+   */
+  inline Hit<T> resolve(size_t i, const Ray<T> &ray, T t) const {
+    tvec3<T> a, b, c;
+    vertices(i, a, b, c);
+    tvec3<T> e1 = b - a, e2 = c - a, n = cross(e1, e2);
+
+    // Interpolate the point from the vertices, so it lies on the triangle plane up to rounding wherever the ray came from
+    tvec3<T> p = ray.point(t) - a;
+    T u = dot(cross(p, e2), n) / dot(n, n);
+    T v = dot(cross(e1, p), n) / dot(n, n);
+    T error = roundingError<T>(7) * (length(a) + length(b) + length(c));
+    return {t, a + e1 * u + e2 * v, normalize(n), error, &materials[material[i]]};
+  }
+};
+
+/*!
+ * Surface given by a signed distance field: a sphere displaced by fractal noise, optionally combined with a second sphere
+ * by constructive solid geometry, e.g. to carve craters into asteroids. Rays are sphere traced, stepping by the distance
+ * divided by the Lipschitz bound of the field, so a step can never cross the surface.
+ */
+template<typename T>
+struct Blob {
+  enum Operation : uint32_t { None, Union, Intersection, Subtraction };
+
+  T radius;
+  tvec3<T> center;
+  // Height of the noise displacement and frequency of its first octave
+  T amplitude, frequency;
+  // Second sphere combined with the displaced one
+  Operation operation;
+  T otherRadius;
+  tvec3<T> otherCenter;
+  Material<T> material;
+
+  /*!
+   * Fractal noise made of products of sines, every octave is rotated so the octaves do not align
+   * Each octave has 0.4 of the amplitude and twice the frequency of the previous one
+   * @param x Horizontal position
+   * @param y Vertical position
+   * @param z Depth position
+   * @return Noise value, at most noiseRange() in magnitude
+   */
+  template<typename S>
+  static inline S noise(S x, S y, S z) {
+    S sum = 0, scale = 1;
+    for (int octave = 0; octave < BLOB_OCTAVES; octave++) {
+      sum += scale * std::sin(x) * std::sin(y) * std::sin(z);
+      // Orthonormal rotation scaled by 2, shifted so the octaves do not share the zero crossings at the origin
+      S nx = S(2) * (S(.8) * y + S(.6) * z) + S(1.7);
+      S ny = S(2) * (S(-.8) * x + S(.36) * y - S(.48) * z) + S(9.2);
+      S nz = S(2) * (S(-.6) * x - S(.48) * y + S(.64) * z) + S(5.3);
+      x = nx; y = ny; z = nz;
+      scale *= S(.4);
+    }
+    return sum;
+  }
+
+  /*!
+   * Largest magnitude of the noise
+   * @return Sum of the octave amplitudes
+   */
+  static constexpr T noiseRange() {
+    return (1 - ipow(T(.4), BLOB_OCTAVES)) / (1 - T(.4));
+  }
+
+  /*!
+   * Bound of the noise gradient, the gradient of a product of three sines is at most 1 long
+   * @return Sum of the octave slopes
+   */
+  static constexpr T noiseSlope() {
+    return (1 - ipow(T(.8), BLOB_OCTAVES)) / (1 - T(.8));
+  }
+
+  static constexpr T ipow(T base, int exponent) {
+    return exponent == 0 ? 1 : base * ipow(base, exponent - 1);
+  }
+
+  /*!
+   * Evaluate the signed distance field, negative inside
+   * @param x Horizontal position
+   * @param y Vertical position
+   * @param z Depth position
+   * @return Distance bound of the point to the surface
+   */
+  template<typename S>
+  inline S field(S x, S y, S z) const {
+    S cx = x - (S) center.x, cy = y - (S) center.y, cz = z - (S) center.z;
+    S f = (S) frequency;
+    S d = std::sqrt(cx * cx + cy * cy + cz * cz) - (S) radius - (S) amplitude * noise(cx * f, cy * f, cz * f);
+
+    S ox = x - (S) otherCenter.x, oy = y - (S) otherCenter.y, oz = z - (S) otherCenter.z;
+    S other = std::sqrt(ox * ox + oy * oy + oz * oz) - (S) otherRadius;
+    switch (operation) {
+      case Union: return std::min(d, other);
+      case Intersection: return std::max(d, other);
+      case Subtraction: return std::max(d, -other);
+      default: return d;
+    }
+  }
+
+  /*!
+   * Evaluate the signed distance field for several points in SIMD lanes
+   * @param x Horizontal positions
+   * @param y Vertical positions
+   * @param z Depth positions
+   * @param d Output distances
+   * @param count Number of points
+   */
+  template<typename S>
+  inline void fields(const S *x, const S *y, const S *z, S *d, int count) const {
+    #pragma omp simd
+    for (int i = 0; i < count; i++)
+      d[i] = field(x[i], y[i], z[i]);
+  }
+
+  /*!
+   * Lipschitz bound of the field, distances divided by it are safe steps, CSG with spheres keeps the bound
+   * @return Largest change of the field per unit of distance
+   */
+  inline T lipschitz() const {
+    return 1 + amplitude * frequency * noiseSlope();
+  }
+
+  /*!
+   * Sphere that contains the whole surface
+   * @param boundCenter Output center of the sphere
+   * @param boundRadius Output radius of the sphere
+   */
+  void bounds(tvec3<T> &boundCenter, T &boundRadius) const {
+    boundCenter = center;
+    boundRadius = radius + abs(amplitude) * noiseRange();
+    if (operation != Union) return;
+
+    // Smallest sphere containing both spheres
+    T separation = length(otherCenter - boundCenter);
+    if (separation + otherRadius <= boundRadius) return;
+    if (separation + boundRadius <= otherRadius) {
+      boundCenter = otherCenter;
+      boundRadius = otherRadius;
+      return;
+    }
+    T merged = (separation + boundRadius + otherRadius) / 2;
+    boundCenter += (otherCenter - boundCenter) * ((merged - boundRadius) / separation);
+    boundRadius = merged;
+  }
+
+  /*!
+   * Distance to the surface counted as a collision
+   * @return Absolute tolerance of the sphere tracing
+   */
+  inline T tolerance() const {
+    return (T) BLOB_PRECISION * radius;
+  }
+
+  /*!
+   * Find the part of a ray inside the bounding sphere
+   * @param origin Ray origin
+   * @param direction Normalized ray direction
+   * @param enter Output distance where the ray enters the sphere, 0 when it starts inside
+   * @param exit Output distance where the ray leaves the sphere
+   * @return False when the ray misses the sphere
+   */
+  template<typename S>
+  inline bool clip(const tvec3<S> &origin, const tvec3<S> &direction, S &enter, S &exit) const {
+    tvec3<T> boundCenter;
+    T boundRadius;
+    bounds(boundCenter, boundRadius);
+    tvec3<S> oc = origin - tvec3<S>{boundCenter};
+    S b = dot(oc, direction);
+    S dis = b * b - dot(oc, oc) + (S) (boundRadius * boundRadius);
+    if (dis < 0) return false;
+    enter = std::max(-b - std::sqrt(dis), S(0));
+    exit = -b + std::sqrt(dis);
+    return exit > 0;
+  }
+
+  /*!
+   * Sphere trace a ray to the surface, rays starting inside march to where they leave
+   * The ray origin needs to be at least the hit error away from the surface, as offsetOrigin ensures
+   * @param ray Ray with normalized direction
+   * @return Distance of the collision or MAX_DISTANCE
+   */
+  inline T distance(const Ray<T> &ray) const {
+    T t, exit;
+    if (!clip(ray.origin, ray.direction, t, exit)) return MAX_DISTANCE<T>;
+
+    T step = 1 / lipschitz(), epsilon = tolerance();
+    T side = field(ray.origin.x, ray.origin.y, ray.origin.z) < 0 ? -1 : 1;
+    for (int i = 0; i < BLOB_STEPS && t <= exit; i++) {
+      auto point = ray.point(t);
+      T d = side * field(point.x, point.y, point.z);
+      if (d < epsilon) return t;
+      t += d * step;
+    }
+    return MAX_DISTANCE<T>;
+  }
+
+  /*!
+   * Sphere trace all rays of a packet together in single precision, the field is evaluated for all lanes in SIMD
+   * Packets start away from any surface so the rays start outside
+   * @param packet Rays to trace
+   * @param t Output distance of the collision for each lane or infinity
+   */
+  inline void hit(const Packet &packet, float (&t)[PACKET_SIZE]) const {
+    float exit[PACKET_SIZE];
+    bool active[PACKET_SIZE], found[PACKET_SIZE];
+    int remaining = 0;
+    for (int j = 0; j < PACKET_SIZE; j++) {
+      vec3 origin{packet.ox[j], packet.oy[j], packet.oz[j]}, direction{packet.dx[j], packet.dy[j], packet.dz[j]};
+      t[j] = exit[j] = 0;
+      active[j] = clip(origin, direction, t[j], exit[j]) && t[j] < packet.tmax[j];
+      exit[j] = std::min(exit[j], packet.tmax[j]);
+      found[j] = false;
+      remaining += active[j];
+    }
+
+    auto step = (float) (1 / lipschitz()), epsilon = (float) tolerance();
+    float x[PACKET_SIZE], y[PACKET_SIZE], z[PACKET_SIZE], d[PACKET_SIZE];
+    for (int i = 0; i < BLOB_STEPS && remaining > 0; i++) {
+      for (int j = 0; j < PACKET_SIZE; j++) {
+        x[j] = packet.ox[j] + packet.dx[j] * t[j];
+        y[j] = packet.oy[j] + packet.dy[j] * t[j];
+        z[j] = packet.oz[j] + packet.dz[j] * t[j];
+      }
+      fields(x, y, z, d, PACKET_SIZE);
+
+      remaining = 0;
+      for (int j = 0; j < PACKET_SIZE; j++) {
+        bool converged = d[j] < epsilon;
+        found[j] = found[j] || (active[j] && converged);
+        t[j] = active[j] && !converged ? t[j] + d[j] * step : t[j];
+        active[j] = active[j] && !converged && t[j] <= exit[j];
+        remaining += active[j];
+      }
+    }
+
+    // Lanes that left the bounds or ran out of steps missed
+    for (int j = 0; j < PACKET_SIZE; j++)
+      t[j] = found[j] ? t[j] : PACKET_INF;
+  }
+
+  /*!
+   * Compute collision details
+   * The normal is the field gradient estimated from four evaluations on a tetrahedron, done together in SIMD lanes
+   * @param ray Ray that collided with the blob
+   * @param t Distance of the collision
+   * @return Hit structure that represents the collision
+   */
+  inline Hit<T> resolve(const Ray<T> &ray, T t) const {
+    auto point = ray.point(t);
+    T h = tolerance();
+    T x[4] = {point.x + h, point.x - h, point.x - h, point.x + h};
+    T y[4] = {point.y - h, point.y - h, point.y + h, point.y + h};
+    T z[4] = {point.z - h, point.z + h, point.z - h, point.z + h};
+    T d[4];
+    fields(x, y, z, d, 4);
+    tvec3<T> gradient{d[0] - d[1] - d[2] + d[3], -d[0] - d[1] + d[2] + d[3], -d[0] + d[1] - d[2] + d[3]};
+
+    // The point lies within the tracing tolerance from the surface, offsets need to clear it on both sides
+    T error = 4 * h * lipschitz() + roundingError<T>(8) * length(point);
+    return {t, point, normalize(gradient), error, &material};
+  }
+};
+
+/*!
+ * Single precision accumulation buffer that collects samples of all render passes
+ * Along with the color sum it keeps the sum of squared luminance so the noise of each pixel can be estimated
+ */
+struct Film {
+  /*!
+   * Accumulated samples of a single pixel
+   */
+  struct Pixel {
+    vec3 sum;
+    float squares;
+    unsigned int samples;
+    // Sums of the first collision of each sample that guide the denoiser
+    vec3 albedo, normal;
+    float depth;
+    // Number of samples that collided with anything, the sums of the first collision are averaged over these,
+    // scaled together with the sums when samples are reused
+    float hits;
+  };
+
+  int width, height;
+  vector<Pixel> pixels;
+
+  /*!
+   * Create empty film
+   * @param width Width in pixels
+   * @param height Height in pixels
+   */
+  Film(int width, int height) : width{width}, height{height}, pixels(width * height, Pixel{{0, 0, 0}, 0, 0, {0, 0, 0}, {0, 0, 0}, 0, 0}) {}
+
+  /*!
+   * Luminance of a color used to estimate the noise
+   * @param color Color to measure
+   * @return Perceived brightness
+   */
+  static float luminance(const vec3 &color) {
+    return dot(color, {0.2126f, 0.7152f, 0.0722f});
+  }
+
+  /*!
+   * Estimate the variance of the mean pixel luminance
+   * @param pixel Pixel to estimate
+   * @return Variance, the squared mean until there are enough samples to estimate it
+   */
+  static double variance(const Pixel &pixel) {
+    double mean = luminance(pixel.sum) / std::max(pixel.samples, 1u);
+    if (pixel.samples < 2) return mean * mean;
+
+    double variance = std::max(0.0, (pixel.squares / pixel.samples - mean * mean) * pixel.samples / (pixel.samples - 1));
+    return variance / pixel.samples;
+  }
+
+  /*!
+   * Estimate the relative standard error of the pixel luminance
+   * Pixels darker than 0.1 are measured relative to 0.1 so the black parts of the image do not dominate
+   * @param pixel Pixel to estimate
+   * @return Relative error, infinity until there are enough samples to estimate it
+   */
+  static double error(const Pixel &pixel) {
+    if (pixel.samples < 2) return INF;
+
+    double mean = luminance(pixel.sum) / pixel.samples;
+    return sqrt(variance(pixel)) / std::max(mean, 0.1);
+  }
+
+  /*!
+   * Estimate remaining noise as the average relative standard error of all pixels
+   * @return Relative error, infinity until there are enough samples to estimate it
+   */
+  double noise() const {
+    double total = 0;
+    for (auto &pixel : pixels)
+      total += error(pixel);
+    return total / pixels.size();
+  }
+
+  /*!
+   * Count samples taken in all pixels
+   * @return Total number of samples
+   */
+  unsigned long samples() const {
+    unsigned long total = 0;
+    for (auto &pixel : pixels)
+      total += pixel.samples;
+    return total;
+  }
+
+  /*!
+   * Resolve the accumulated samples to an image
+   * @param image Image of the same size as the film
+   */
+  void develop(Image &image) const {
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        auto &pixel = pixels[y * width + x];
+        auto color = pixel.sum / (float) std::max(pixel.samples, 1u);
+        image.setPixel(x, y, color.r, color.g, color.b);
       }
+    }
+  }
 
-      t = (-b + e) / a;
+  /*!
+   * Resolve the accumulated samples to an image filtered by the denoiser
+   * @param image Image of the same size as the film
+   * @param scheduler Scheduler splitting the film into tiles
+   * @param iterations Number of filter passes
+   */
+  void developDenoised(Image &image, TileScheduler &scheduler, int iterations = 5) const {
+    Denoiser::Frame frame;
+    for (auto &pixel : pixels) {
+      auto samples = (float) std::max(pixel.samples, 1u);
+      auto hits = std::max(pixel.hits, 1.0f);
+      frame.color.push_back(pixel.sum / samples);
+      frame.variance.push_back((float) variance(pixel));
+      frame.albedo.push_back(pixel.albedo / hits);
+      frame.normal.push_back(pixel.normal == vec3{0, 0, 0} ? pixel.normal : normalize(pixel.normal));
+      frame.depth.push_back(pixel.depth / hits);
+    }
 
-      if ( t > EPS ) {
-        dvec3 pt = ray.point(t);
-        dvec3 n = normalize(pt - center);
-        return {t, pt, n, material};
+    auto color = Denoiser{width, height, iterations}.filter(frame, scheduler);
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        auto &value = color[y * width + x];
+        image.setPixel(x, y, value.r, value.g, value.b);
+      }
+    }
+  }
+
+  /*!
+   * Visualize the number of samples taken in each pixel, white pixels took the most samples
+   * @param image Image of the same size as the film
+   */
+  void developSamples(Image &image) const {
+    unsigned int most = 1;
+    for (auto &pixel : pixels)
+      most = std::max(most, pixel.samples);
+
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        auto value = (float) pixels[y * width + x].samples / most;
+        image.setPixel(x, y, value, value, value);
       }
     }
-    return noHit;
   }
 };
 
 /*!
- * Generate a normalized vector that sits on the surface of a half-sphere which is defined using a normal. Used to generate random diffuse reflections.
- * @param normal Normal that defines the dome/half-sphere direction
- * @return Random 3D vector on the dome surface
+ * State of a path traced from the camera, kept between bounces so paths can be advanced one bounce at a time
  */
-inline dvec3 RandomDome(const dvec3 &normal) {
-  double d;
-  dvec3 p;
+template<typename T>
+struct Path {
+  Ray<T> ray;
+  // Collision of the ray, the next surface to shade
+  Hit<T> hit;
+  Sampler sampler;
+  // Index of the pixel the path contributes to
+  uint32_t pixel;
+  tvec3<T> throughput{1, 1, 1};
+  tvec3<T> color{0, 0, 0};
+  unsigned int bounce = 0;
+  // Density of the last diffuse bounce, emission it reaches is weighted against sampling the lights directly
+  T bouncePdf = 0;
+  tvec3<T> bounceOrigin{};
+};
 
-  do {
-    p = sphericalRand(1.0);
-    d = dot(p, normal);
-  } while(d < 0);
+/*!
+ * Light sample waiting for its shadow ray to be tested
+ */
+template<typename T>
+struct Shadow {
+  Ray<T> ray;
+  // Distance to the light, 0 when there is nothing to test
+  T distance;
+  // Light added to the path when the shadow ray is not blocked
+  tvec3<T> light;
+  // Index of the light sphere, it is not tested as an occluder
+  uint32_t target;
+};
 
-  return p;
-}
+/*!
+ * Options that control how the world is rendered
+ */
+struct RenderSettings {
+  // Maximum number of collisions to trace
+  unsigned int depth = 5;
+  // Trace primary rays in packets, otherwise every ray is cast separately
+  bool packets = true;
+  // Advance all paths of a tile together one bounce at a time, otherwise each path is traced to the end separately
+  bool wavefront = false;
+  // Relative error under which a pixel is considered converged, 0 samples all pixels
+  double threshold = 0;
+  // Maximum number of samples in a pixel
+  unsigned int limit = numeric_limits<unsigned int>::max();
+  // Part of the film to render, empty renders the whole film, needs to be aligned to the packet size
+  Tile region{0, 0, 0, 0};
+  // Frame of an animated sequence, consecutive frames use different samples
+  uint32_t frame = 0;
+};
 
 /*!
  * Structure to represent the scene/world to render
  */
+template<typename T>
 struct World {
-  Camera camera;
-  vector<Sphere> spheres;
+  Camera<T> camera;
+  vector<Sphere<T>> spheres;
+  Triangles<T> triangles{};
+  vector<Blob<T>> blobs{};
+  // Spheres packed by build for the collision tests, indexed the same as the spheres
+  Spheres<T> sphereData{};
+  BVH bvh{};
+  // Indices of emissive spheres that are sampled directly from diffuse surfaces, emissive triangles are not sampled
+  vector<uint32_t> lights{};
+  // First triangle of each instance of the scene file, so animated instances can be moved in place
+  vector<uint32_t> instanceTriangles{};
+  // Cost of the BVH when it was last built, refitted hierarchies are compared against it
+  float builtCost = 0;
+
+  /*!
+   * Convert camera of a scene file
+   * @param camera Camera of the scene file
+   * @return Camera in the precision of the world
+   */
+  static Camera<T> convert(const SceneFile::Camera &camera) {
+    return {tvec3<T>{camera.position}, tvec3<T>{camera.back}, tvec3<T>{camera.up}, tvec3<T>{camera.right}};
+  }
+
+  /*!
+   * Create world from a scene file, lights of the file are ignored as only emissive spheres are sampled
+   * @param scene Loaded scene file
+   * @return World with all spheres, blobs and mesh instances of the scene, build needs to be called before rendering
+   */
+  static World load(const SceneFile &scene) {
+    World world{};
+    world.camera = convert(scene.camera);
+
+    vector<Material<T>> materials;
+    for (auto &material : scene.materials)
+      materials.push_back({tvec3<T>{material.emission}, tvec3<T>{material.diffuse}, (T) material.reflectivity,
+                           (T) material.transparency, (T) material.refractionIndex});
+
+    world.spheres.reserve(scene.spheres.size());
+    for (auto &sphere : scene.spheres)
+      world.spheres.push_back({(T) sphere.radius, tvec3<T>{sphere.center}, materials[sphere.material]});
+
+    for (auto &blob : scene.blobs)
+      world.blobs.push_back({(T) blob.radius, tvec3<T>{blob.center}, (T) blob.amplitude, (T) blob.frequency,
+                             (typename Blob<T>::Operation) blob.operation, (T) blob.otherRadius, tvec3<T>{blob.otherCenter},
+                             materials[blob.material]});
+
+    size_t count = 0;
+    for (auto &instance : scene.instances)
+      count += scene.geometries[instance.geometry].vertices.size() / 3;
+    world.triangles.reserve(count);
+    for (auto &instance : scene.instances) {
+      world.instanceTriangles.push_back((uint32_t) world.triangles.size());
+      world.addMesh(scene.geometries[instance.geometry], instance.transform, materials[instance.material]);
+    }
+    return world;
+  }
+
+  /*!
+   * Move the camera and the animated objects of the scene file the world was loaded from to a frame
+   * Triangles of animated instances are transformed in place, update needs to be called afterwards
+   * @param scene Scene file the world was loaded from
+   * @param frame Frame to move to
+   */
+  void animate(const SceneFile &scene, double frame) {
+    camera = convert(scene.cameraAt(frame));
+    for (size_t i = 0; i < scene.spheres.size(); i++)
+      if (!scene.spheres[i].keys.empty()) spheres[i].center = tvec3<T>{scene.spheres[i].centerAt(frame)};
+
+    for (size_t i = 0; i < scene.instances.size(); i++) {
+      auto &instance = scene.instances[i];
+      if (instance.keys.empty()) continue;
+      auto transform = instance.transformAt(frame);
+      auto &vertices = scene.geometries[instance.geometry].vertices;
+      for (size_t j = 0; j + 2 < vertices.size(); j += 3)
+        triangles.set(instanceTriangles[i] + j / 3, place(transform, vertices[j]), place(transform, vertices[j + 1]),
+                      place(transform, vertices[j + 2]));
+    }
+  }
+
+  /*!
+   * Transform a mesh vertex into the world
+   * @param transform Transformation of the mesh
+   * @param vertex Vertex in model space
+   * @return Vertex in world space
+   */
+  static vec3 place(const dmat4 &transform, const vec3 &vertex) {
+    return vec3{transform * dvec4{dvec3{vertex}, 1}};
+  }
+
+  /*!
+   * Add a transformed copy of the triangles of a mesh into the world
+   * @param geometry Triangles of the mesh
+   * @param transform Transformation to apply to the mesh vertices
+   * @param material Material of the whole mesh
+   */
+  void addMesh(const SceneFile::Geometry &geometry, const dmat4 &transform, const Material<T> &material) {
+    auto materialIndex = (uint32_t) triangles.materials.size();
+    triangles.materials.push_back(material);
+
+    auto &vertices = geometry.vertices;
+    for (size_t i = 0; i + 2 < vertices.size(); i += 3)
+      triangles.add(place(transform, vertices[i]), place(transform, vertices[i + 1]), place(transform, vertices[i + 2]), materialIndex);
+  }
+
+  /*!
+   * Prepare the spheres for collision tests and build the bounding volume hierarchy over all spheres and triangles,
+   * needs to be called after the scene changes
+   * Spheres are indexed first, triangles and blobs follow after them
+   * @param hierarchy Build the BVH, otherwise all objects are tested for every ray
+   */
+  void build(bool hierarchy = true) {
+    sphereData.clear();
+    for (auto &sphere : spheres)
+      sphereData.add(sphere);
+
+    bvh = {};
+    if (hierarchy) bvh.build(bounds());
+    builtCost = bvh.cost();
+
+    lights.clear();
+    for (uint32_t i = 0; i < spheres.size(); i++)
+      if (spheres[i].material.emission != tvec3<T>{0, 0, 0}) lights.push_back(i);
+  }
+
+  /*!
+   * Update the acceleration structures after objects moved, the BVH is refitted instead of rebuilt
+   * Refitting keeps the tree structure, so it is rebuilt once its estimated cost grows too much over the built one
+   * @return True when the BVH had to be rebuilt
+   */
+  bool update() {
+    sphereData.clear();
+    for (auto &sphere : spheres)
+      sphereData.add(sphere);
+
+    if (bvh.nodes.empty()) return false;
+    auto boxes = bounds();
+    bvh.refit(boxes);
+    if (bvh.cost() <= builtCost * REFIT_LIMIT) return false;
+
+    bvh.build(boxes);
+    builtCost = bvh.cost();
+    return true;
+  }
+
+  /*!
+   * Compute bounding boxes of all objects, spheres are indexed first, triangles and blobs follow after them
+   * @return Box for each object
+   */
+  vector<BVH::Box> bounds() const {
+    vector<BVH::Box> boxes;
+    boxes.reserve(spheres.size() + triangles.size() + blobs.size());
+    for (auto &sphere : spheres)
+      boxes.push_back(BVH::Box::bounds(sphere.center - sphere.radius, sphere.center + sphere.radius));
+    for (size_t i = 0; i < triangles.size(); i++)
+      boxes.push_back(triangles.bounds(i));
+    for (auto &blob : blobs) {
+      tvec3<T> center;
+      T radius;
+      blob.bounds(center, radius);
+      boxes.push_back(BVH::Box::bounds(center - radius, center + radius));
+    }
+    return boxes;
+  }
+
+  /*!
+   * Send the scene description to another process, the acceleration structures are not sent
+   * @param channel Channel to the process
+   */
+  void send(Channel &channel) const {
+    channel.send(camera);
+    channel.send(spheres);
+    for (auto vertices : {&triangles.ax, &triangles.ay, &triangles.az, &triangles.bx, &triangles.by, &triangles.bz,
+                          &triangles.cx, &triangles.cy, &triangles.cz})
+      channel.send(*vertices);
+    channel.send(triangles.material);
+    channel.send(triangles.materials);
+    channel.send(blobs);
+  }
+
+  /*!
+   * Receive the scene description sent by send, build needs to be called afterwards
+   * @param channel Channel to the process that sent the scene
+   */
+  void receive(Channel &channel) {
+    // Primitives are indexed by 32 bit integers, anything larger is a broken stream
+    constexpr uint64_t limit = numeric_limits<uint32_t>::max();
+    channel.receive(camera);
+    channel.receive(spheres, limit);
+    for (auto vertices : {&triangles.ax, &triangles.ay, &triangles.az, &triangles.bx, &triangles.by, &triangles.bz,
+                          &triangles.cx, &triangles.cy, &triangles.cz})
+      channel.receive(*vertices, limit);
+    channel.receive(triangles.material, limit);
+    channel.receive(triangles.materials, limit);
+    channel.receive(blobs, limit);
+  }
 
   /*!
    * Compute ray to object collision with any object in the world
+   * Falls back to testing all objects when the BVH was not built
    * @param ray Ray to trace collisions for
    * @return Hit or noHit structure which indicates the material and distance the ray has collided with
    */
-  inline Hit cast(const Ray &ray) const {
-    Hit hit = noHit;
-    for (auto &sphere : spheres) {
-      auto lh = sphere.hit(ray);
+  inline Hit<T> cast(const Ray<T> &ray) const {
+    // Only the distance and index of the closest primitive are tracked, the details are resolved once at the end
+    uint32_t closest = NO_PRIMITIVE;
+    T tmax = MAX_DISTANCE<T>;
+    auto shear = Triangles<T>::shear(ray);
 
-      if (lh.distance < hit.distance) {
-        hit = lh;
+    auto intersect = [&](uint32_t index, T &t) {
+      auto distance = this->distance(index, ray, shear);
+      if (distance < t) {
+        t = distance;
+        closest = index;
+      }
+    };
+
+    if (bvh.nodes.empty()) {
+      // Test batches of spheres in SIMD lanes
+      T t[SPHERE_BATCH];
+      for (size_t first = 0; first < sphereData.size(); first += SPHERE_BATCH) {
+        auto count = std::min(SPHERE_BATCH, sphereData.size() - first);
+        sphereData.distances(ray, first, count, t);
+        for (size_t i = 0; i < count; i++) {
+          if (t[i] < tmax) {
+            tmax = t[i];
+            closest = (uint32_t) (first + i);
+          }
+        }
       }
+      for (auto i = (uint32_t) sphereData.size(); i < primitives(); i++)
+        intersect(i, tmax);
+    } else {
+      bvh.closest(ray.origin, ray.direction, tmax, intersect);
     }
-    return hit;
+    return resolve(closest, ray, tmax);
   }
 
   /*!
-   * Trace a ray as it collides with objects in the world
-   * @param ray Ray to trace
-   * @param depth Maximum number of collisions to trace
-   * @return Color representing the accumulated lighting for each ray collision
+   * Compute collision details for the primitive a ray collided with
+   * @param index Index of the primitive or NO_PRIMITIVE
+   * @param ray Ray that collided with the primitive
+   * @param t Distance of the collision
+   * @return Hit or noHit structure which indicates the material and distance the ray has collided with
+   */
+  inline Hit<T> resolve(uint32_t index, const Ray<T> &ray, T t) const {
+    if (index == NO_PRIMITIVE) return noHit<T>;
+    if (index < sphereData.size()) return sphereData.resolve(index, ray, t);
+    index -= (uint32_t) sphereData.size();
+    if (index < triangles.size()) return triangles.resolve(index, ray, t);
+    return blobs[index - triangles.size()].resolve(ray, t);
+  }
+
+  /*!
+   * Compute distance of ray to primitive collision
+   * @param index Index of the primitive, spheres come first, then triangles and blobs
+   * @param ray Ray to compute collision against
+   * @param shear Shear of the ray for the triangle test
+   * @return Distance of the collision or MAX_DISTANCE
+   */
+  inline T distance(uint32_t index, const Ray<T> &ray, const typename Triangles<T>::Shear &shear) const {
+    if (index < sphereData.size()) return sphereData.distance(index, ray);
+    index -= (uint32_t) sphereData.size();
+    if (index < triangles.size()) return triangles.hit(index, ray, shear);
+    return blobs[index - triangles.size()].distance(ray);
+  }
+
+  /*!
+   * Number of primitives indexed by the BVH
+   * @return Number of spheres, triangles and blobs
    */
-  inline dvec3 trace(const Ray &ray, unsigned int depth) const {
-    if (depth == 0) return {0, 0, 0};
+  inline uint32_t primitives() const {
+    return (uint32_t) (sphereData.size() + triangles.size() + blobs.size());
+  }
 
-    const Hit hit = cast(ray);
+  /*!
+   * Check whether any object blocks the ray, the traversal stops at the first collision found
+   * @param ray Ray to check
+   * @param distance Only collisions closer than this distance are considered
+   * @param target Index of the sphere the ray is aimed at, it is skipped so rounding can not make it block the ray
+   * @return True if the ray is blocked
+   */
+  inline bool occluded(const Ray<T> &ray, T distance, uint32_t target) const {
+    auto shear = Triangles<T>::shear(ray);
 
-    // No hit
-    if ( std::isinf(hit.distance)) return {0, 0, 0};
+    auto intersect = [&](uint32_t index, T t) {
+      return index != target && this->distance(index, ray, shear) < t;
+    };
 
-    // Emission
-    dvec3 color = hit.material.emission;
+    if (bvh.nodes.empty()) {
+      for (uint32_t i = 0; i < primitives(); i++)
+        if (intersect(i, distance)) return true;
+      return false;
+    }
+    return bvh.any(ray.origin, ray.direction, distance, intersect);
+  }
+
+  /*!
+   * Probability density of sampleLight choosing a direction, the cones of several lights may overlap
+   * @param point Point the direction starts from
+   * @param direction Normalized direction
+   * @return Density with respect to the solid angle
+   */
+  inline T lightPdf(const tvec3<T> &point, const tvec3<T> &direction) const {
+    T pdf = 0;
+    for (auto index : lights) {
+      auto &light = spheres[index];
+      tvec3<T> toLight = light.center - point;
+      T distance = length(toLight);
+      if (distance <= light.radius) continue;
+
+      T sinMax = light.radius / distance;
+      T cosMax = sqrt(std::max(T(0), 1 - sinMax * sinMax));
+      if (dot(direction, toLight) >= cosMax * distance) pdf += 1 / (2 * pi<T>() * (1 - cosMax));
+    }
+    return pdf / (T) lights.size();
+  }
+
+  /*!
+   * Weight of a sampling strategy combined with another one using the power heuristic of multiple importance sampling
+   * @param pdf Density of the strategy that produced the sample
+   * @param other Density of the other strategy for the same direction
+   * @return Weight of the sample
+   */
+  static T misWeight(T pdf, T other) {
+    return pdf * pdf / (pdf * pdf + other * other);
+  }
+
+  /*!
+   * Sample light arriving directly from a randomly chosen emissive sphere to a diffuse surface
+   * Directions are sampled uniformly in the cone the sphere covers, which works for both small and very close lights.
+   * The result is weighted against the diffuse bounce hitting the same light, which is better for large lights
+   * @param hit Collision with the diffuse surface, the normal has to face the incoming ray
+   * @param choice Random number that selects the light
+   * @param point Random point that selects the direction towards the light
+   * @return Shadow ray to test and the reflected light, yet to be multiplied by the diffuse color of the surface
+   */
+  inline Shadow<T> sampleLight(const Hit<T> &hit, double choice, const dvec2 &point) const {
+    const Shadow<T> none{{}, 0, {0, 0, 0}, 0};
+    auto target = lights[std::min((size_t) (choice * lights.size()), lights.size() - 1)];
+    auto &light = spheres[target];
+    tvec3<T> toLight = light.center - hit.point;
+    T distance = length(toLight);
+    // Points on the light itself are lit by its emission already
+    if (distance <= light.radius) return none;
 
-    // Decide to reflect or refract using linear random
-    if (linearRand(0.0f, 1.0f) < hit.material.transparency) {
+    T sinMax = light.radius / distance;
+    T cosMax = sqrt(std::max(T(0), 1 - sinMax * sinMax));
+    Ray<T> shadowRay{offsetOrigin(hit.point, hit.normal, hit.error), Sampler::uniformCone(toLight / distance, cosMax, point)};
+    T cosine = dot(shadowRay.direction, hit.normal);
+    if (cosine <= 0) return none;
+
+    T lightDistance = sphereData.distance(target, shadowRay);
+    if (lightDistance == MAX_DISTANCE<T>) return none;
+
+    // Diffuse reflectance over PI times the cosine divided by the probability of the direction
+    T pdf = lightPdf(hit.point, shadowRay.direction);
+    T bouncePdf = cosine / pi<T>();
+    return {shadowRay, lightDistance, sphereData.materials[target].emission * bouncePdf / pdf * misWeight(pdf, bouncePdf), target};
+  }
+
+  /*!
+   * Compute collisions for a packet of coherent rays that start away from any surface, e.g. primary rays of neighbouring pixels
+   * The hierarchy and primitives are tested for all lanes together in single precision,
+   * the closest primitive of each lane is then intersected again in full precision so the hits match the scalar cast
+   * @param rays Rays to trace, one for each lane
+   * @param hits Output hit for each ray
+   */
+  void cast(const Ray<T> (&rays)[PACKET_SIZE], Hit<T> (&hits)[PACKET_SIZE]) const {
+    Packet packet;
+    uint32_t closest[PACKET_SIZE];
+    for (int i = 0; i < PACKET_SIZE; i++) {
+      packet.set(i, vec3{rays[i].origin}, vec3{rays[i].direction}, PACKET_INF);
+      closest[i] = NO_PRIMITIVE;
+    }
+
+    auto intersect = [&](uint32_t index, Packet &packet) {
+      float t[PACKET_SIZE];
+      if (index < sphereData.size())
+        sphereData.hit(index, packet, t);
+      else if (index < sphereData.size() + triangles.size())
+        triangles.hit(index - sphereData.size(), packet, t);
+      else
+        blobs[index - sphereData.size() - triangles.size()].hit(packet, t);
+
+      #pragma omp simd
+      for (int i = 0; i < PACKET_SIZE; i++) {
+        bool closer = t[i] < packet.tmax[i];
+        packet.tmax[i] = closer ? t[i] : packet.tmax[i];
+        closest[i] = closer ? index : closest[i];
+      }
+    };
+
+    if (bvh.nodes.empty()) {
+      for (uint32_t i = 0; i < primitives(); i++)
+        intersect(i, packet);
+    } else {
+      bvh.closest(packet, intersect);
+    }
+
+    // Resolve the closest primitives, fall back to the scalar cast when the full precision test disagrees
+    for (int i = 0; i < PACKET_SIZE; i++) {
+      auto &ray = rays[i];
+      auto index = closest[i];
+      if (index == NO_PRIMITIVE) {
+        hits[i] = noHit<T>;
+        continue;
+      }
+
+      auto distance = this->distance(index, ray, Triangles<T>::shear(ray));
+      hits[i] = distance < MAX_DISTANCE<T> ? resolve(index, ray, distance) : cast(ray);
+    }
+  }
+
+  /*!
+   * Add light emitted by the surface the path collided with
+   * @param path Path to update
+   */
+  inline void emit(Path<T> &path) const {
+    auto &emission = path.hit.material->emission;
+    if (path.bouncePdf > 0)
+      path.color += path.throughput * emission * misWeight(path.bouncePdf, lightPdf(path.bounceOrigin, path.ray.direction));
+    else
+      path.color += path.throughput * emission;
+  }
+
+  /*!
+   * Scatter the path on the surface it collided with
+   * The light carried back along the path is tracked as throughput, dim paths are ended early by Russian roulette
+   * and diffuse surfaces sample the emissive spheres directly, combined with the diffuse bounce by multiple importance sampling
+   * @param path Path to update, its ray is replaced by the scattered ray
+   * @param depth Maximum number of collisions to trace
+   * @param shadow Output light sample of diffuse surfaces, its distance stays 0 when there is nothing to test
+   * @return True if the path continues and the scattered ray needs to be cast
+   */
+  inline bool scatter(Path<T> &path, unsigned int depth, Shadow<T> &shadow) const {
+    auto &hit = path.hit;
+    auto &material = *hit.material;
+    auto &ray = path.ray;
+    shadow.distance = 0;
+
+    // Every bounce uses the same sample dimensions for the same decisions, whichever way the path goes
+    auto event = path.sampler.next1D();
+    auto lightChoice = path.sampler.next1D();
+    auto lightPoint = path.sampler.next2D();
+    auto scatterPoint = path.sampler.next2D();
+    auto roulette = path.sampler.next1D();
+
+    // Decide to reflect or refract randomly
+    if (event < material.transparency) {
       // Flip normal if the ray is "inside" a sphere
-      dvec3 normal = dot(ray.direction, hit.normal) < 0 ? hit.normal : -hit.normal;
+      tvec3<T> normal = dot(ray.direction, hit.normal) < 0 ? hit.normal : -hit.normal;
       // Reverse the refraction index as well
-      double r_index = dot(ray.direction, hit.normal) < 0 ? 1/hit.material.refractionIndex : hit.material.refractionIndex;
+      T r_index = dot(ray.direction, hit.normal) < 0 ? 1/material.refractionIndex : material.refractionIndex;
 
       // Prepare refraction ray
-      dvec3 refraction = refract(ray.direction, normal, r_index);
-      Ray refractionRay{hit.point - normal * DELTA, refraction};
+      tvec3<T> refraction = refract(ray.direction, normal, r_index);
+      ray = {offsetOrigin(hit.point, -normal, hit.error), refraction};
       // Modulate the refraction color with diffuse color
-      dvec3 refractionColor = lerp(hit.material.diffuse, {1,1,1}, hit.material.transparency);
-      // Trace the ray recursively
-      color += refractionColor * trace(refractionRay, depth - 1);
+      path.throughput *= lerp(material.diffuse, {1,1,1}, material.transparency);
+      path.bouncePdf = 0;
     } else {
+      // Diffuse surfaces reflect light from the side the ray came from
+      tvec3<T> normal = dot(ray.direction, hit.normal) < 0 ? hit.normal : -hit.normal;
+
+      // Sample the lights directly unless this is the last collision of the path
+      bool diffuse = material.reflectivity == 0 && !lights.empty();
+      if (diffuse && path.bounce + 1 < depth) {
+        shadow = sampleLight({hit.distance, hit.point, normal, hit.error, hit.material}, lightChoice, lightPoint);
+        shadow.light *= path.throughput * material.diffuse;
+      }
+
       // Calculate reflection
-      // Random diffuse reflection
-      dvec3 diffuse = RandomDome(hit.normal);
+      // Random diffuse reflection, directions are distributed by the cosine term so no further weighting is needed
+      tvec3<T> scatter = Sampler::cosineHemisphere(normal, scatterPoint);
       // Ideal specular reflection
-      dvec3 reflection = reflect(ray.direction, hit.normal);
+      tvec3<T> reflection = reflect(ray.direction, hit.normal);
       // Ray that combines reflection direction depending on the material reflectivness
-      Ray reflectedRay{hit.point + hit.normal * DELTA, lerp(diffuse, reflection, hit.material.reflectivity)};
+      ray = {offsetOrigin(hit.point, normal, hit.error), lerp(scatter, reflection, material.reflectivity)};
+      path.bouncePdf = diffuse ? dot(scatter, normal) / pi<T>() : 0;
+      path.bounceOrigin = hit.point;
       // Reflection color is white for specular reflections, otherwise diffuse color is used
-      dvec3 reflectionColor = lerp(hit.material.diffuse, {1, 1, 1}, hit.material.reflectivity);
-      // Trace the ray recursively
-      color += reflectionColor * trace(reflectedRay, depth - 1);
+      path.throughput *= lerp(material.diffuse, {1, 1, 1}, material.reflectivity);
     }
 
-    return color;
+    // Russian roulette, continue with probability given by the throughput and make up for the ended paths
+    if (path.bounce >= ROULETTE_BOUNCES) {
+      T survival = std::min(std::max(std::max(path.throughput.r, path.throughput.g), path.throughput.b), T(0.95));
+      if (roulette >= survival) return false;
+      path.throughput /= survival;
+    }
+
+    return ++path.bounce < depth;
   }
 
   /*!
-   * Render the world to the provided image
-   * @param image Image to render to
+   * Follow a path from its first collision to the end, each bounce continues the path instead of recursing
+   * @param path Path that collided with the world
+   * @param depth Maximum number of collisions to trace
+   * @return Color representing the accumulated lighting for each ray collision
    */
-  void render(Image& image, unsigned int samples, unsigned int depth) const {
-    // For each pixel generate rays
-    #pragma omp parallel for
-    for (int y = 0; y < image.height; ++y) {
-      for (int x = 0; x < image.width; ++x) {
-        dvec3 color{};
+  inline tvec3<T> trace(Path<T> path, unsigned int depth) const {
+    while (path.bounce < depth && path.hit.distance != MAX_DISTANCE<T>) {
+      emit(path);
+
+      Shadow<T> shadow;
+      bool alive = scatter(path, depth, shadow);
+      if (shadow.distance > 0 && !occluded(shadow.ray, shadow.distance, shadow.target)) path.color += shadow.light;
+      if (!alive) break;
+
+      path.hit = cast(path.ray);
+    }
+    return path.color;
+  }
+
+  /*!
+   * Advance all paths together one bounce at a time
+   * Each bounce shades the paths sorted by their material, tests all shadow rays, then casts the scattered rays
+   * sorted by their direction so neighbouring rays visit the same BVH nodes, paths that end are dropped from the queue
+   * @param paths Paths that collided with the world, their color is updated
+   * @param depth Maximum number of collisions to trace
+   */
+  void traceWavefront(vector<Path<T>> &paths, unsigned int depth) const {
+    vector<uint32_t> queue(paths.size()), next;
+    iota(queue.begin(), queue.end(), 0);
+    vector<pair<uint32_t, Shadow<T>>> shadows;
+    vector<uint32_t> keys(paths.size());
+
+    auto sortQueue = [&](vector<uint32_t> &indices) {
+      sort(indices.begin(), indices.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+    };
+
+    while (!queue.empty()) {
+      // Shade in batches of the same material type so the same branch runs for neighbouring paths
+      for (auto i : queue) {
+        auto &material = *paths[i].hit.material;
+        keys[i] = material.transparency > 0 ? 2 : material.reflectivity > 0 ? 1 : 0;
+      }
+      sortQueue(queue);
 
-        // Generate multiple samples
-        for (unsigned int i = 0; i < samples; ++i) {
-          auto ray = camera.generateRay(x, y, image.width, image.height);
-          color = color + trace(ray, depth);
+      next.clear();
+      shadows.clear();
+      for (auto i : queue) {
+        emit(paths[i]);
+        Shadow<T> shadow;
+        if (scatter(paths[i], depth, shadow)) next.push_back(i);
+        if (shadow.distance > 0) shadows.push_back({i, shadow});
+      }
+
+      // Test shadow rays
+      for (auto &shadow : shadows)
+        if (!occluded(shadow.second.ray, shadow.second.distance, shadow.second.target)) paths[shadow.first].color += shadow.second.light;
+
+      // Cast scattered rays sorted by direction octant and quantized direction, keep the paths that hit something
+      for (auto i : next) {
+        auto &direction = paths[i].ray.direction;
+        auto quantize = [](T value) { return std::min((uint32_t) ((value + 1) * 8), 15u); };
+        keys[i] = (direction.x < 0) << 10 | (direction.y < 0) << 9 | (direction.z < 0) << 8
+                  | quantize(direction.x) << 4 | quantize(direction.y);
+      }
+      sortQueue(next);
+
+      queue.clear();
+      for (auto i : next) {
+        paths[i].hit = cast(paths[i].ray);
+        if (paths[i].hit.distance != MAX_DISTANCE<T>) queue.push_back(i);
+      }
+    }
+  }
+
+  /*!
+   * Generate primary rays for a block of neighbouring pixels
+   * @param x Horizontal position of the top left pixel
+   * @param y Vertical position of the top left pixel
+   * @param width Width of the viewport
+   * @param height Height of the viewport
+   * @param sample Index of the sample
+   * @param rays Output rays, one for each lane
+   * @param samplers Output samplers that continue the paths of the rays
+   * @param frame Frame of a sequence, each frame gets differently scrambled samples
+   */
+  void generatePacket(int x, int y, int width, int height, unsigned int sample,
+                      Ray<T> (&rays)[PACKET_SIZE], Sampler (&samplers)[PACKET_SIZE], uint32_t frame = 0) const {
+    for (int i = 0; i < PACKET_SIZE; i++) {
+      int px = x + i % PACKET_WIDTH, py = y + i / PACKET_WIDTH;
+      samplers[i] = Sampler{(uint32_t) (py * width + px) + frame * (uint32_t) (width * height), sample};
+      rays[i] = camera.generateRay(px, py, width, height, samplers[i].next2D());
+    }
+  }
+
+  /*!
+   * Find the pixel of the previous frame that shows the same surface as a pixel of this frame
+   * The pixel center is traced in this frame and projected by the previous camera, the previous pixel is accepted when its
+   * first collisions agree with the traced one in distance, normal and albedo
+   * @param x Horizontal position of the pixel
+   * @param y Vertical position of the pixel
+   * @param previous Film of the previous frame
+   * @param view Camera of the previous frame
+   * @return Index of the previous pixel or -1 when the surface was not visible there
+   */
+  int findPrevious(int x, int y, const Film &previous, const Camera<T> &view) const {
+    int width = previous.width, height = previous.height;
+    auto ray = camera.generateRay(x, y, width, height, {.5, .5});
+    auto hit = cast(ray);
+    if (!hit.material) return -1;
+
+    // Invert the ray generation of the previous camera, its vectors are orthogonal
+    auto offset = hit.point - view.position;
+    auto forward = -dot(offset, view.back) / dot(view.back, view.back);
+    if (forward <= 0) return -1;
+    tvec3<T> vdu = T(2) * view.right / (T)width;
+    tvec3<T> vdv = T(2) * -view.up / (T)height;
+    auto u = dot(offset, vdu) / (forward * dot(vdu, vdu));
+    auto v = dot(offset, vdv) / (forward * dot(vdv, vdv));
+    int px = (int) floor(u) + width / 2, py = (int) floor(v) + height / 2;
+    if (px < 0 || py < 0 || px >= width || py >= height) return -1;
+
+    auto &pixel = previous.pixels[py * width + px];
+    if (pixel.hits <= 0 || pixel.normal == vec3{0, 0, 0}) return -1;
+    auto distance = (float) length(offset);
+    auto albedo = pixel.albedo / pixel.hits - vec3{hit.material->diffuse};
+    auto normal = vec3{dot(hit.normal, ray.direction) < 0 ? hit.normal : -hit.normal};
+    if (abs(pixel.depth / pixel.hits - distance) > REPROJECT_DEPTH * distance) return -1;
+    if (dot(normalize(pixel.normal), normal) < REPROJECT_NORMAL) return -1;
+    if (dot(albedo, albedo) > 0.01f) return -1;
+    return py * width + px;
+  }
+
+  /*!
+   * Start the film of a frame with the samples of the previous frame where the same surfaces stay visible
+   * Blocks of the packet size are reused only as a whole so all their pixels keep the same number of samples.
+   * Reused pixels are scaled down to at most history samples, so changes in shading blend in over a few frames.
+   * @param previous Film of the previous frame
+   * @param view Camera of the previous frame
+   * @param film Empty film of this frame with the same size
+   * @param history Maximum number of samples carried over to a pixel
+   * @param scheduler Scheduler splitting the film into tiles
+   * @return Number of pixels that reuse previous samples
+   */
+  unsigned long reproject(const Film &previous, const Camera<T> &view, Film &film, unsigned int history,
+                          TileScheduler &scheduler) const {
+    vector<unsigned long> reused(scheduler.getThreads());
+
+    scheduler.run([&](const Tile &tile, unsigned thread) {
+      for (int y = tile.y; y < tile.y + tile.height; y += PACKET_HEIGHT) {
+        for (int x = tile.x; x < tile.x + tile.width; x += PACKET_WIDTH) {
+          int sources[PACKET_SIZE];
+          unsigned int samples = history;
+          for (int lane = 0; lane < PACKET_SIZE && samples > 0; lane++) {
+            int px = x + lane % PACKET_WIDTH, py = y + lane / PACKET_WIDTH;
+            sources[lane] = -1;
+            if (px >= tile.x + tile.width || py >= tile.y + tile.height) continue;
+            sources[lane] = findPrevious(px, py, previous, view);
+            samples = sources[lane] < 0 ? 0 : std::min(samples, previous.pixels[sources[lane]].samples);
+          }
+          if (samples == 0) continue;
+
+          for (int lane = 0; lane < PACKET_SIZE; lane++) {
+            if (sources[lane] < 0) continue;
+            auto &source = previous.pixels[sources[lane]];
+            auto scale = (float) samples / source.samples;
+            film.pixels[(y + lane / PACKET_WIDTH) * film.width + x + lane % PACKET_WIDTH] =
+                {source.sum * scale, source.squares * scale, samples, source.albedo * scale, source.normal * scale,
+                 source.depth * scale, source.hits * scale};
+            reused[thread]++;
+          }
         }
-        // Collect the data
-        color = color / (double) samples;
-        image.setPixel(x, y, (float)color.r, (float)color.g, (float)color.b);
       }
+    });
+
+    return accumulate(reused.begin(), reused.end(), 0UL);
+  }
+
+  /*!
+   * Render a pass that adds one sample to each pixel that still needs it
+   * Pixels are sampled in blocks of the packet size, a block is skipped once all its pixels reached the error threshold
+   * Only the region of the settings is sampled when it is set
+   * @param film Film that accumulates the samples, sample indices continue after the samples it already holds
+   * @param settings Options of the rendering
+   * @param scheduler Scheduler splitting the film into tiles, its threads are kept between passes
+   * @return Number of samples taken in this pass, 0 when all pixels are finished
+   */
+  unsigned long render(Film &film, const RenderSettings &settings, TileScheduler &scheduler) const {
+    auto region = settings.region.width > 0 ? settings.region : Tile{0, 0, film.width, film.height};
+    // Only the parts of the tiles inside the region are sampled, the tiles are a multiple of the packet size
+    // so packets only reach outside of a tile on the image border or the border of an unaligned region
+    vector<Tile> tiles;
+    for (auto &tile : scheduler.getTiles()) {
+      int x = std::max(tile.x, region.x), y = std::max(tile.y, region.y);
+      int width = std::min(tile.x + tile.width, region.x + region.width) - x;
+      int height = std::min(tile.y + tile.height, region.y + region.height) - y;
+      if (width > 0 && height > 0) tiles.push_back({x, y, width, height});
     }
+    // Each thread collects the paths of its tile separately and adds them to the film once finished
+    vector<vector<Path<T>>> buffers(scheduler.getThreads());
+    vector<unsigned long> taken(scheduler.getThreads());
+
+    scheduler.run((uint32_t) tiles.size(), [&](uint32_t index, unsigned thread) {
+      auto &tile = tiles[index];
+      auto &paths = buffers[thread];
+      paths.clear();
+
+      // For each block of pixels generate rays
+      for (int y = 0; y < tile.height; y += PACKET_HEIGHT) {
+        for (int x = 0; x < tile.width; x += PACKET_WIDTH) {
+          // Blocks are always sampled together so all their pixels hold the same number of samples
+          auto sample = film.pixels[(tile.y + y) * film.width + tile.x + x].samples;
+          if (sample >= settings.limit) continue;
+
+          // Sample the block while any of its pixels needs more samples
+          bool active = settings.threshold <= 0 || sample < ADAPTIVE_MIN_SAMPLES;
+          for (int lane = 0; lane < PACKET_SIZE && !active; lane++) {
+            int px = x + lane % PACKET_WIDTH, py = y + lane / PACKET_WIDTH;
+            if (px >= tile.width || py >= tile.height) continue;
+            active = Film::error(film.pixels[(tile.y + py) * film.width + tile.x + px]) > settings.threshold;
+          }
+          if (!active) continue;
+
+          Ray<T> rays[PACKET_SIZE];
+          Hit<T> hits[PACKET_SIZE];
+          Sampler samplers[PACKET_SIZE];
+          generatePacket(tile.x + x, tile.y + y, film.width, film.height, sample, rays, samplers, settings.frame);
+          if (settings.packets) {
+            cast(rays, hits);
+          } else {
+            for (int lane = 0; lane < PACKET_SIZE; lane++)
+              hits[lane] = cast(rays[lane]);
+          }
+
+          for (int lane = 0; lane < PACKET_SIZE; lane++) {
+            int px = x + lane % PACKET_WIDTH, py = y + lane / PACKET_WIDTH;
+            if (px >= tile.width || py >= tile.height) continue;
+            Path<T> path{rays[lane], hits[lane], samplers[lane], (uint32_t) ((tile.y + py) * film.width + tile.x + px)};
+
+            // Record the first collision for the denoiser
+            auto &hit = hits[lane];
+            if (hit.material) {
+              auto &pixel = film.pixels[path.pixel];
+              pixel.albedo += vec3{hit.material->diffuse};
+              pixel.normal += vec3{dot(hit.normal, rays[lane].direction) < 0 ? hit.normal : -hit.normal};
+              pixel.depth += (float) hit.distance;
+              pixel.hits++;
+            }
+
+            if (!settings.wavefront) path.color = trace(path, settings.depth);
+            paths.push_back(path);
+          }
+        }
+      }
+
+      if (settings.wavefront) traceWavefront(paths, settings.depth);
+
+      // Collect the data, tiles do not overlap so threads never write the same pixel
+      for (auto &path : paths) {
+        auto &pixel = film.pixels[path.pixel];
+        auto luminance = Film::luminance(path.color);
+        pixel.sum += vec3{path.color};
+        pixel.squares += luminance * luminance;
+        pixel.samples++;
+      }
+      taken[thread] += paths.size();
+    });
+
+    return accumulate(taken.begin(), taken.end(), 0UL);
   }
+
 };
 
-int main() {
+/*!
+ * Measure primary ray throughput for growing number of spheres without the BVH, with the BVH and with packets of rays
+ * @param world World with the default scene, its camera and walls are reused
+ * @return Process exit code
+ */
+template<typename T>
+int benchmark(const World<T> &world) {
+  constexpr int size = 256;
+  constexpr int linearLimit = 10000;
+  TileScheduler scheduler{size, size, 16};
+
+  cout << setw(10) << "spheres" << setw(14) << "build [ms]" << setw(18) << "BVH [Mray/s]" << setw(21) << "packet [Mray/s]"
+       << setw(21) << "linear [Mray/s]" << endl;
+  for (int count : {9, 100, 1000, 10000, 100000}) {
+    // Keep the walls and the default spheres, fill the rest of the room with small random spheres
+    World<T> scene = world;
+    auto radius = (T) (8.0 / cbrt((double) count));
+    Random random{(uint64_t) count};
+    auto randomVector = [&]() { return tvec3<T>{random.uniform(), random.uniform(), random.uniform()}; };
+    while ((int) scene.spheres.size() < count) {
+      Material<T> material{ {0, 0, 0}, randomVector(), 0, 0, 0 };
+      scene.spheres.push_back({ radius, randomVector() * T(18) - T(9), material });
+    }
+
+    // Generate primary rays in packet order up front so only the casting is measured
+    constexpr int packetCount = size * size / PACKET_SIZE;
+    vector<Ray<T>> rays(size * size);
+    for (int i = 0; i < packetCount; ++i) {
+      int x = i % (size / PACKET_WIDTH) * PACKET_WIDTH, y = i / (size / PACKET_WIDTH) * PACKET_HEIGHT;
+      Ray<T> packet[PACKET_SIZE];
+      Sampler samplers[PACKET_SIZE];
+      scene.generatePacket(x, y, size, size, 0, packet, samplers);
+      copy(begin(packet), end(packet), rays.begin() + i * PACKET_SIZE);
+    }
+
+    // Cast all primary rays once and measure the throughput
+    auto measure = [&](bool packets) {
+      auto start = chrono::steady_clock::now();
+      // Packets are the work items of the scheduler, each thread sums up the distances on its own
+      vector<double> hits(scheduler.getThreads());
+      scheduler.run(packetCount, [&](uint32_t i, unsigned thread) {
+        Ray<T> packet[PACKET_SIZE];
+        Hit<T> result[PACKET_SIZE];
+        copy(rays.begin() + i * PACKET_SIZE, rays.begin() + (i + 1) * PACKET_SIZE, packet);
+        if (packets) {
+          scene.cast(packet, result);
+        } else {
+          for (int lane = 0; lane < PACKET_SIZE; lane++)
+            result[lane] = scene.cast(packet[lane]);
+        }
+        for (auto &hit : result)
+          hits[thread] += hit.distance;
+      });
+      chrono::duration<double> time = chrono::steady_clock::now() - start;
+      return size * size / time.count() / 1e6;
+    };
+
+    // Testing all spheres takes too long for the large scenes
+    scene.build(false);
+    auto linear = count <= linearLimit ? measure(false) : 0.0;
+
+    auto start = chrono::steady_clock::now();
+    scene.build();
+    chrono::duration<double, milli> buildTime = chrono::steady_clock::now() - start;
+
+    cout << setw(10) << count << fixed << setprecision(2) << setw(14) << buildTime.count() << setw(18) << measure(false)
+         << setw(21) << measure(true);
+    if (linear > 0) cout << setw(21) << linear << endl;
+    else cout << setw(21) << "-" << endl;
+  }
+  return EXIT_SUCCESS;
+}
+
+/*!
+ * Render tiles for a coordinator until it sends an empty tile
+ * The world, settings and film size are received first, then each tile is rendered to the end and its pixels are sent back
+ * @param channel Channel to the coordinator
+ * @return Process exit code
+ */
+template<typename T>
+int work(Channel &channel) {
+  World<T> world{};
+  world.receive(channel);
+  RenderSettings settings;
+  channel.receive(settings);
+  int width, height;
+  channel.receive(width);
+  channel.receive(height);
+  world.build();
+
+  Film film{width, height};
+  TileScheduler scheduler{width, height, 16};
+  while (true) {
+    Tile tile;
+    channel.receive(tile);
+    if (tile.width <= 0) break;
+    if (tile.x < 0 || tile.y < 0 || tile.x + tile.width > width || tile.y + tile.height > height)
+      throw runtime_error("Coordinator sent a tile outside of the film!\n");
+
+    settings.region = tile;
+    while (world.render(film, settings, scheduler) > 0);
+
+    vector<Film::Pixel> pixels;
+    pixels.reserve((size_t) tile.width * tile.height);
+    for (int y = tile.y; y < tile.y + tile.height; y++) {
+      auto row = film.pixels.begin() + y * width + tile.x;
+      pixels.insert(pixels.end(), row, row + tile.width);
+    }
+    channel.send(tile);
+    channel.send(pixels);
+  }
+  return EXIT_SUCCESS;
+}
+
+/*!
+ * Serve a coordinator as a worker, the coordinator chooses the precision
+ * @param channel Channel to the coordinator
+ * @return Process exit code
+ */
+int serve(Channel &channel) {
+  channel.send(WORKER_MAGIC);
+  uint8_t precision;
+  channel.receive(precision);
+  return precision == sizeof(double) ? work<double>(channel) : work<float>(channel);
+}
+
+/*!
+ * Render the film by distributing tiles to worker processes, pixels are collected as the tiles finish
+ * Each worker keeps a second tile queued so it never waits for the coordinator between tiles
+ * Pixels are sent as raw floats, so the workers need the same architecture as the coordinator
+ * @param world World to render
+ * @param settings Options of the rendering, the region is set for each tile
+ * @param film Film to collect the pixels to
+ * @param workers Channels to the worker processes
+ * @param progress Callback called after each finished tile with the number of finished tiles and the number of all tiles
+ */
+template<typename T>
+void distribute(const World<T> &world, const RenderSettings &settings, Film &film, vector<Channel> &workers,
+                const function<void(size_t, size_t)> &progress) {
+  for (auto &worker : workers) {
+    // Peers that connected over the network have to prove they are workers of the same build
+    uint32_t magic;
+    worker.receive(magic);
+    if (magic != WORKER_MAGIC) {
+      stringstream msg;
+      msg << "Peer is not a compatible raw3_raytrace worker!" << endl;
+      throw runtime_error(msg.str());
+    }
+    worker.send((uint8_t) sizeof(T));
+    world.send(worker);
+    worker.send(settings);
+    worker.send(film.width);
+    worker.send(film.height);
+  }
+
+  // Tiles follow the Morton curve so the image fills in coherent blocks, their size is a multiple of the packet size
+  auto tiles = TileScheduler{film.width, film.height, 64}.getTiles();
+  size_t next = 0, finished = 0;
+  // Workers answer in order, so each one has a queue of the tiles it was sent and the echoed tile is only verified
+  vector<deque<Tile>> sent(workers.size());
+  auto dispatch = [&](size_t index) {
+    if (next >= tiles.size()) return;
+    workers[index].send(tiles[next]);
+    sent[index].push_back(tiles[next++]);
+  };
+  for (int queued = 0; queued < 2; queued++) {
+    for (size_t index = 0; index < workers.size(); index++)
+      dispatch(index);
+  }
+
+  while (finished < tiles.size()) {
+    auto index = Channel::wait(workers);
+    auto &worker = workers[index];
+    if (sent[index].empty()) throw runtime_error("Worker sent a tile it was not asked for!\n");
+    auto tile = sent[index].front();
+    sent[index].pop_front();
+
+    Tile echoed;
+    vector<Film::Pixel> pixels;
+    worker.receive(echoed);
+    worker.receive(pixels, (uint64_t) tile.width * tile.height);
+    if (echoed.x != tile.x || echoed.y != tile.y || echoed.width != tile.width || echoed.height != tile.height ||
+        pixels.size() != (size_t) tile.width * tile.height) {
+      stringstream msg;
+      msg << "Worker sent " << pixels.size() << " pixels of a different tile than " << tile.width << "x" << tile.height
+          << " at " << tile.x << "," << tile.y << "!" << endl;
+      throw runtime_error(msg.str());
+    }
+    dispatch(index);
+
+    for (int y = 0; y < tile.height; y++)
+      copy_n(pixels.begin() + y * tile.width, tile.width, film.pixels.begin() + (tile.y + y) * film.width + tile.x);
+    progress(++finished, tiles.size());
+  }
+
+  for (auto &worker : workers)
+    worker.send(Tile{0, 0, 0, 0});
+}
+
+/*!
+ * Render an animated sequence of a scene file, frame N is saved to raw3_raytrace_N.bmp
+ * Moving objects only refit the BVH and with reprojection each frame starts from the samples of the previous frame
+ * @param world World loaded from the scene file with the acceleration structure built
+ * @param scene Scene file with the keyframes
+ * @param settings Options of the rendering
+ * @param frames Number of frames to render
+ * @param reproject Reuse samples of the previous frame, up to half of the sample limit per pixel
+ * @param denoise Also save denoised frames to raw3_raytrace_denoised_N.bmp
+ * @return Process exit code
+ */
+template<typename T>
+int sequence(World<T> &world, const SceneFile &scene, RenderSettings settings, unsigned int frames, bool reproject, bool denoise) {
+  using Clock = chrono::steady_clock;
+  auto start = Clock::now();
+  Image image{512, 512};
+  Film previous{image.width, image.height};
+  TileScheduler scheduler{image.width, image.height, 16};
+  auto view = world.camera;
+  auto history = std::max(settings.limit / 2, 1u);
+
+  for (unsigned int frame = 0; frame < frames; frame++) {
+    auto frameStart = Clock::now();
+    world.animate(scene, frame);
+    bool rebuilt = world.update();
+
+    Film film{image.width, image.height};
+    unsigned long reused = 0, taken = 0, pass;
+    if (reproject && frame > 0) reused = world.reproject(previous, view, film, history, scheduler);
+    settings.frame = frame;
+    while ((pass = world.render(film, settings, scheduler)) > 0)
+      taken += pass;
+
+    stringstream name;
+    name << "raw3_raytrace_" << setw(4) << setfill('0') << frame << ".bmp";
+    film.develop(image);
+    image::saveBMP(image, name.str());
+    if (denoise) {
+      film.developDenoised(image, scheduler);
+      name.str("");
+      name << "raw3_raytrace_denoised_" << setw(4) << setfill('0') << frame << ".bmp";
+      image::saveBMP(image, name.str());
+    }
+
+    chrono::duration<double> elapsed = Clock::now() - frameStart;
+    cout << "Frame " << frame + 1 << "/" << frames << ": " << fixed << setprecision(2)
+         << (double) taken / film.pixels.size() << " new samples per pixel, " << setprecision(1)
+         << 100.0 * reused / film.pixels.size() << "% pixels reused, BVH " << (rebuilt ? "rebuilt" : "refitted")
+         << ", " << setprecision(2) << elapsed.count() << "s" << endl;
+
+    previous = move(film);
+    view = world.camera;
+  }
+
+  chrono::duration<double> total = Clock::now() - start;
+  cout << "Sequence rendered in " << setprecision(1) << total.count() << "s" << endl;
+  cout << "Done." << endl;
+  return EXIT_SUCCESS;
+}
+
+/*!
+ * Parse the command line options and render the world
+ * @param argc Number of command line arguments
+ * @param argv Command line arguments
+ * @return Process exit code
+ */
+template<typename T>
+int run(int argc, char *argv[]) {
+  // World to render, loaded before the other options are parsed so meshes can be added to it
+  string path = "raw3_raytrace.scene";
+  for (int i = 1; i + 1 < argc; i++)
+    if (string{argv[i]} == "--scene") path = argv[i + 1];
+  SceneFile scene{path};
+  auto world = World<T>::load(scene);
+
+  // Parse command line options
+  RenderSettings settings;
+  bool denoise = false;
+  unsigned int maxSamples = 0;
+  double timeBudget = 0, noiseTarget = 0, saveInterval = 10;
+  int processes = 0, port = 0, remotes = 1;
+  // Remote workers have to be allowed explicitly by listening on another address than loopback
+  string listenHost = "127.0.0.1";
+  unsigned int frames = 0;
+  bool reproject = false;
+  for (int i = 1; i < argc; i++) {
+    string option{argv[i]};
+    if (option == "--benchmark") {
+      return benchmark(world);
+    } else if (option == "--mesh" && i + 1 < argc) {
+      // Place the mesh into the front right part of the room, the ppgso meshes are about 1 unit large
+      auto transform = scale(translate(dmat4{1.0}, {5, -6, 4}), dvec3{8});
+      world.addMesh(SceneFile::loadGeometry(argv[++i]), transform, { {0, 0, 0}, {.8, .8, .8}, 0, 0, 0 });
+    } else if (option == "--scene" && i + 1 < argc) {
+      // Loaded above
+      i++;
+    } else if (option == "--scalar") {
+      settings.packets = false;
+    } else if (option == "--samples" && i + 1 < argc) {
+      maxSamples = (unsigned int) stoul(argv[++i]);
+    } else if (option == "--time" && i + 1 < argc) {
+      timeBudget = stod(argv[++i]);
+    } else if (option == "--noise" && i + 1 < argc) {
+      noiseTarget = stod(argv[++i]);
+    } else if (option == "--save" && i + 1 < argc) {
+      saveInterval = stod(argv[++i]);
+    } else if (option == "--double") {
+      // Precision is chosen in main
+    } else if (option == "--denoise") {
+      denoise = true;
+    } else if (option == "--wavefront") {
+      settings.wavefront = true;
+    } else if (option == "--adaptive" && i + 1 < argc) {
+      settings.threshold = stod(argv[++i]);
+    } else if (option == "--processes" && i + 1 < argc) {
+      processes = stoi(argv[++i]);
+    } else if (option == "--listen" && i + 1 < argc) {
+      string address{argv[++i]};
+      auto separator = address.rfind(':');
+      if (separator != string::npos) listenHost = address.substr(0, separator);
+      port = stoi(address.substr(separator == string::npos ? 0 : separator + 1));
+    } else if (option == "--workers" && i + 1 < argc) {
+      remotes = stoi(argv[++i]);
+    } else if (option == "--frames" && i + 1 < argc) {
+      frames = (unsigned int) stoul(argv[++i]);
+    } else if (option == "--reproject") {
+      reproject = true;
+    } else {
+      cerr << "Usage: " << argv[0] << " [--scene file.scene] [--mesh file.obj] [--double] [--scalar] [--wavefront] [--samples count] [--time seconds] [--noise error]"
+           << " [--adaptive error] [--denoise] [--save seconds] [--processes count] [--listen [address:]port [--workers count]] [--frames count [--reproject]] [--benchmark]" << endl
+           << "       " << argv[0] << " --worker host:port" << endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Workers render their tiles to the end, budgets over the whole image can not be checked
+  bool distributed = processes > 0 || port > 0;
+  if (distributed && (timeBudget > 0 || noiseTarget > 0)) {
+    cerr << "The --time and --noise budgets are not supported with workers, use --samples or --adaptive" << endl;
+    return EXIT_FAILURE;
+  }
+  if (frames > 0 && (distributed || timeBudget > 0 || noiseTarget > 0)) {
+    cerr << "Sequences support only the --samples and --adaptive budgets on a single process" << endl;
+    return EXIT_FAILURE;
+  }
+
+  // Without any budget render the fixed number of samples, otherwise keep going until a budget runs out
+  if (maxSamples == 0)
+    maxSamples = timeBudget > 0 || noiseTarget > 0 ? numeric_limits<unsigned int>::max() : 32;
+  settings.limit = maxSamples;
+
   cout << "This will take a while ..." << endl;
 
   // Image to render to
   Image image{512, 512};
+  Film film{image.width, image.height};
 
-  // World to render
-  const World world{
-      { // Camera
-          {  0,   0, 25}, // Position
-          {  0,   0,  1}, // Back
-          {  0,  .5,  0}, // Up
-          { .5,   0,  0}, // Right
-      },
-      { // Spheres
-          { 10000, {  0, -10010, 0}, { {0, 0, 0}, {.8, .8, .8}, 0, 0, 0 } },        // Floor
-          { 10000, { -10010, 0, 0}, { { 0, 0, 0}, { 1, 0, 0}, 0, 0, 0 } },          // Left wall
-          { 10000, {  10010, 0, 0}, { { 0, 0, 0}, { 0, 1, 0}, 0, 0, 0 } },          // Right wall
-          { 10000, {  0,0, -10010}, { { 0, 0, 0}, { .8, .8, 0}, 0, 0, 0 } },        // Back wall
-          { 10000, {  0,0, 10030}, { { 0, 0, 0}, { 0, .8, .8}, 0, 0, 0 } },         // Front wall (behind camera)
-          { 10000, {  0,10010, 0}, { { 1, 1, 1}, { .8, .8, .8}, 0, 0, 0 } },        // Ceiling and source of light
-          {     2, { -5,  -8,  3}, { { 0, 0, 0}, { .7, .7, 0}, 1, .95, 1.52 } },    // Refractive glass sphere
-          {     4, {  0,  -6,  0}, { { 0, 0, 0}, { .7, .5, .1}, 1, 0, 0 } },        // Reflective sphere
-          {    10, {  10, 10, -10}, { { 0, 0, 0}, { 0, 0, 1}, 0, 0, 1.54 } },       // Sphere in top right corner
-      },
-  };
+  // Build the acceleration structure
+  world.build();
+  if (frames > 0) return sequence(world, scene, settings, frames, reproject, denoise);
+
+  using Clock = chrono::steady_clock;
+  auto start = Clock::now(), saved = start;
+  if (distributed) {
+    // Start local workers and wait for the remote ones to connect
+    vector<Channel> workers;
+    for (int i = 0; i < processes; i++)
+      workers.push_back(Channel::fork(serve));
+    if (port > 0) {
+      cout << "Waiting for " << remotes << " workers on " << listenHost << ":" << port << " ..." << endl;
+      for (auto &worker : Channel::accept(listenHost, port, remotes))
+        workers.push_back(move(worker));
+    }
+
+    // Assemble the tiles as they arrive
+    distribute(world, settings, film, workers, [&](size_t finished, size_t total) {
+      auto now = Clock::now();
+      chrono::duration<double> elapsed = now - start, sinceSave = now - saved;
+      cout << "\rTiles: " << finished << "/" << total << " Time: " << fixed << setprecision(1) << elapsed.count() << "s" << flush;
+
+      if (saveInterval > 0 && sinceSave.count() >= saveInterval) {
+        film.develop(image);
+        image::saveBMP(image, "raw3_raytrace.bmp");
+        saved = now;
+      }
+    });
+  }
 
-  // Render the scene
-  world.render(image, 32, 5);
+  // Render the scene progressively, one sample per pixel that is not finished yet in each pass
+  unsigned int passes = 0;
+  TileScheduler scheduler{film.width, film.height, 16};
+  while (!distributed && world.render(film, settings, scheduler) > 0) {
+    auto now = Clock::now();
+    chrono::duration<double> elapsed = now - start, sinceSave = now - saved;
+    auto pass = elapsed.count() / ++passes;
+
+    auto noise = film.noise();
+    cout << "\rSamples: " << fixed << setprecision(2) << (double) film.samples() / film.pixels.size()
+         << " Noise: " << setprecision(4);
+    if (noise < INF) cout << noise; else cout << "-";
+    cout << " Time: " << setprecision(1) << elapsed.count() << "s" << flush;
+
+    // Stop when the target is reached or when the next pass would not fit into the budget
+    if (noiseTarget > 0 && noise <= noiseTarget) break;
+    if (timeBudget > 0 && elapsed.count() + pass > timeBudget) break;
+
+    // Save intermediate result so it can be inspected during long renders
+    if (saveInterval > 0 && sinceSave.count() >= saveInterval) {
+      film.develop(image);
+      image::saveBMP(image, "raw3_raytrace.bmp");
+      saved = now;
+    }
+  }
+  cout << endl;
 
   // Save the result
+  film.develop(image);
   image::saveBMP(image, "raw3_raytrace.bmp");
 
+  if (denoise) {
+    auto denoiseStart = Clock::now();
+    film.developDenoised(image, scheduler);
+    chrono::duration<double> denoiseTime = Clock::now() - denoiseStart;
+    image::saveBMP(image, "raw3_raytrace_denoised.bmp");
+    cout << "Denoised in " << setprecision(2) << denoiseTime.count() << "s" << endl;
+  }
+
+  // Compare the samples taken with sampling every pixel as often as the most sampled one
+  if (settings.threshold > 0) {
+    unsigned int most = 0;
+    for (auto &pixel : film.pixels)
+      most = std::max(most, pixel.samples);
+    auto taken = film.samples();
+    auto uniform = (unsigned long) most * film.pixels.size();
+    cout << "Adaptive sampling: " << taken << " samples taken, " << uniform << " with uniform sampling, "
+         << uniform - taken << " (" << setprecision(1) << 100.0 * (uniform - taken) / uniform << "%) saved" << endl;
+
+    film.developSamples(image);
+    image::saveBMP(image, "raw3_raytrace_samples.bmp");
+  }
+
   cout << "Done." << endl;
   return EXIT_SUCCESS;
 }
+
+int main(int argc, char *argv[]) {
+  // Workers receive everything they need from the coordinator
+  if (argc == 3 && string{argv[1]} == "--worker") {
+    string address{argv[2]};
+    auto separator = address.rfind(':');
+    if (separator == string::npos) {
+      cerr << "Worker address needs to be in the form host:port" << endl;
+      return EXIT_FAILURE;
+    }
+    auto channel = Channel::connect(address.substr(0, separator), stoi(address.substr(separator + 1)));
+    return serve(channel);
+  }
+
+  // Single precision is the fast default, double precision can be used to check the results
+  bool precise = find(argv + 1, argv + argc, string{"--double"}) != argv + argc;
+  return precise ? run<double>(argc, argv) : run<float>(argc, argv);
+}
@@ -1,8 +1,13 @@
 // Example raw4_raster
 // - This example implements a very simple software rasterizer that mimics parts of the OpenGL pipeline with vertex and fragment shaders
 // - Some of the pipeline steps such as culling, clipping were skipped for simplicity and readability
-// - Triangle rendering is realized using horizontal triangle splitting and filling is implemented using linear interpolation
+// - Triangles are rasterized in 8x8 pixel tiles using edge functions, tiles outside of a triangle are skipped and tiles
+//   completely inside skip the coverage test, the pixels of a tile row are evaluated together in SIMD lanes
+// - Meshes are indexed, each vertex is shaded once and faces are assembled from the transformed vertices
+// - Faces are sorted into 64x64 pixel bins in parallel, then threads rasterize the bins independently, all phases share
+//   the persistent threads of one TileScheduler
 
+#include <algorithm>
 #include <iostream>
 #include <ppgso/ppgso.h>
 #include <glm/gtx/euler_angles.hpp>
@@ -11,6 +16,11 @@ using namespace std;
 using namespace glm;
 using namespace ppgso;
 
+constexpr int TILE_SIZE = 8;        // Triangles are rasterized in square tiles, one row of a tile is processed in SIMD lanes
+constexpr int BIN_SIZE = 64;        // Triangles are sorted into square bins of tiles, each bin is rendered by one thread
+constexpr float SUBPIXEL = 16.0f;   // Vertices snap to 1/SUBPIXEL of a pixel so edge functions are exact
+constexpr int VERTEX_BLOCK = 1024;  // Vertices are shaded in blocks, each block is one item for the scheduler
+
 /*!
  * Vertex structure to hold per vertex data in
  */
@@ -22,28 +32,11 @@ struct Vertex {
 };
 
 /*!
- * Vertex interpolation function that interpolates position, normal, texCoord and color vectors between two vertices
- * @param v0 First vertex
- * @param v1 Second vertex
- * @param t Interpolation amount, range <0,1>
- * @return Linear combination of v0 and v1
+ * Indexed triangle mesh, each vertex is stored once and three consecutive indices form a triangle/face
  */
-Vertex lerp(const Vertex &v0, const Vertex &v1, float t) {
-  auto z = lerp(1.0f / v0.position.z, 1.0f / v1.position.z, t);
-  auto texCoord = lerp(v0.texCoord / v0.position.z, v1.texCoord / v1.position.z, t) / z;
-  return Vertex{
-      lerp(v0.position, v1.position, t),
-      lerp(v0.normal, v1.normal, t),
-      texCoord,
-      lerp(v0.color, v1.color, t)
-  };
-}
-
-/*!
- * Face structure to hold three vertices that form a triangle/face
- */
-struct Face {
-  Vertex v0, v1, v2;
+struct IndexedMesh {
+  vector<Vertex> vertices;
+  vector<uint32_t> indices;
 };
 
 class Program {
@@ -100,97 +93,251 @@ private:
     auto x = (int) (textCoord.x * (image.width - 1));
     auto y = (int) (textCoord.y * (image.height - 1));
     // NOTE: The coordinates are vertically inverted for compatibility with object files generated using Blender 3D.
-    auto pixel = image.getPixel(x, image.height-y);
+    auto pixel = image.getPixel(x, image.height - 1 - y);
     // Return normalized color vector
     return vec4{pixel.r / 255.0f, pixel.g / 255.0f, pixel.b / 255.0f, 1.0};
   }
 };
 
+/*!
+ * Triangle prepared for rasterization in viewport coordinates
+ * Edge k lies opposite of vertex k, its edge function a*x + b*y + c is positive inside the triangle and equals the
+ * doubled area at vertex k, so edge functions divided by the area are the screen space barycentric coordinates.
+ */
+struct Triangle {
+  Vertex v[3];
+  double a[3], b[3], c[3];
+  bool topLeft[3];
+  float invArea;
+  int minX, minY, maxX, maxY;
+};
+
+/*!
+ * Screen tile that triangles are binned into, it owns its color and depth memory so one thread renders it without locks
+ */
+struct Bin {
+  // Pixels of the bin row by row, allocated for a whole bin even on the image border
+  vector<Image::Pixel> color;
+  vector<float> depth;
+  // Triangles overlapping the bin in submission order, one list per chunk of the binning phase
+  vector<vector<uint32_t>> triangles;
+};
+
 /*!
  * Simple rasterizer class that can render triangles into an image
+ * Rendering runs in parallel phases, first the vertices are shaded, then faces are assembled and binned into screen
+ * tiles and finally each tile rasterizes its triangles into its own memory.
  */
 class Rasterizer {
 private:
   Program &program;
   Image &image;
-  vector<float> depthBuffer;
+  TileScheduler scheduler;
+  int binsX;
+  vector<Bin> bins;
+  // Vertices after the vertex shader and viewport transformation, shared by all faces using them
+  vector<Vertex> transformed;
+  vector<Triangle> triangles;
 
   /*!
    * Transform a vertex from screen coordinates to viewport/image coordinates
    * @param vertex Vertex to transform to viewport. The visible range is <-1,1> for x and y coordinates
-   * @return Vertex that has position transformed to viewport/image coordinates
+   * @return Vertex that has position transformed to viewport/image coordinates and 1/w stored in w for perspective correction
    */
   Vertex toViewport(const Vertex &vertex) {
     // Matrix that aligns the screen coordinates to viewport coordinates
     static const mat4 viewportMatrix = glm::translate(glm::scale(mat4{1.0f}, vec3{image.width / 2.0, -image.height / 2.0, 1.0}), vec3{1, -1, 0});
     // First convert homogeneous coordinates to cartesian and transform to viewport
     vec4 viewportCoordinates = viewportMatrix * (vertex.position / vertex.position.w);
+    viewportCoordinates.w = 1.0f / vertex.position.w;
     // Copy rest of the data without change
     return Vertex{viewportCoordinates, vertex.normal, vertex.texCoord, vertex.color};
   }
 
   /*!
-   * Set the pixel in the output using the varying data stored in Vertex
-   * @param x Fragment horizontal position
-   * @param y Fragment vertical position
-   * @param varying Varying vertex data to pass to fragment shader which will generate the pixel color
+   * Set up edge functions of a triangle
+   * @param triangle Triangle with viewport vertices to set up, vertices may be swapped to make the area positive
+   * @return False if the triangle covers no pixels
+   */
+  bool setup(Triangle &triangle) {
+    auto &v = triangle.v;
+    // Clipping is not implemented, skip triangles reaching behind the camera
+    if (v[0].position.w <= 0 || v[1].position.w <= 0 || v[2].position.w <= 0)
+      return false;
+
+    // Snap to the sub-pixel grid, edge functions are then computed exactly in double precision
+    for (auto &vertex : v) {
+      vertex.position.x = round(vertex.position.x * SUBPIXEL) / SUBPIXEL;
+      vertex.position.y = round(vertex.position.y * SUBPIXEL) / SUBPIXEL;
+    }
+
+    double x0 = v[0].position.x, y0 = v[0].position.y;
+    double area = (v[1].position.x - x0) * (v[2].position.y - y0) - (v[2].position.x - x0) * (v[1].position.y - y0);
+    if (area == 0)
+      return false;
+    // Faces are not culled, flip the winding of back facing triangles
+    if (area < 0) {
+      swap(v[1], v[2]);
+      area = -area;
+    }
+    triangle.invArea = (float) (1.0 / area);
+
+    for (int k = 0; k < 3; k++) {
+      auto &p = v[(k + 1) % 3].position, &q = v[(k + 2) % 3].position;
+      triangle.a[k] = (double) p.y - q.y;
+      triangle.b[k] = (double) q.x - p.x;
+      // Reversing the edge negates a, b and c exactly, so triangles sharing it never both cover a pixel
+      triangle.c[k] = (double) p.x * q.y - (double) q.x * p.y;
+      // Pixels exactly on an edge belong to the triangle if it is a left edge or a horizontal top edge
+      triangle.topLeft[k] = triangle.a[k] > 0 || (triangle.a[k] == 0 && triangle.b[k] > 0);
+    }
+
+    auto minimum = glm::min(glm::min(vec2{v[0].position}, vec2{v[1].position}), vec2{v[2].position});
+    auto maximum = glm::max(glm::max(vec2{v[0].position}, vec2{v[1].position}), vec2{v[2].position});
+    triangle.minX = std::max(0, (int) floor(minimum.x));
+    triangle.minY = std::max(0, (int) floor(minimum.y));
+    triangle.maxX = std::min(image.width - 1, (int) ceil(maximum.x));
+    triangle.maxY = std::min(image.height - 1, (int) ceil(maximum.y));
+    return triangle.minX <= triangle.maxX && triangle.minY <= triangle.maxY;
+  }
+
+  /*!
+   * Test a square block of pixels against the edges of a triangle
+   * @param triangle Triangle to test
+   * @param x Horizontal position of the top left pixel of the block
+   * @param y Vertical position of the top left pixel of the block
+   * @param size Width and height of the block
+   * @param edges Output edge functions at the center of the top left pixel
+   * @param covered Output true if all pixels of the block are inside the triangle
+   * @return False if no pixel of the block is inside the triangle
    */
-  void setFragment(const Vertex &varying) {
-    int x = (int) varying.position.x;
-    int y = (int) varying.position.y;
-    // Do not render pixels outside of the image
-    if (x < 0 || y < 0 || x >= image.width || y >= image.height)
-      return;
-
-    // Check and update the depth buffer
-    if (depthBuffer[x + y * image.width] < varying.position.z)
-      return;
-
-    depthBuffer[x + y * image.height] = varying.position.z;
-
-    // Compute the fragment color and limit the output
-    vec4 color = clamp(program.fragmentShader(varying), 0.0f, 1.0f);
-    image.setPixel(x, y, color.r, color.g, color.b);
+  static bool overlaps(const Triangle &triangle, int x, int y, int size, double edges[3], bool &covered) {
+    double extent = size - 1;
+    covered = true;
+    for (int k = 0; k < 3; k++) {
+      double a = triangle.a[k], b = triangle.b[k];
+      edges[k] = a * (x + .5) + b * (y + .5) + triangle.c[k];
+      // Edge functions are linear, so their extremes over the block are at its corners
+      double high = edges[k] + std::max(a, 0.0) * extent + std::max(b, 0.0) * extent;
+      double low = edges[k] + std::min(a, 0.0) * extent + std::min(b, 0.0) * extent;
+      if (high < 0)
+        return false;
+      covered = covered && low > 0;
+    }
+    return true;
   }
 
   /*!
-   * Fill the top portion of a triangle that has split horizontally by using interpolation between vertices
-   * @param v0 - Top vertex of the triangle
-   * @param v1 - First bottom vertex
-   * @param v2 - Second bottom vertex
+   * Rasterize the pixels of a triangle inside a tile, each row of the tile is evaluated in SIMD lanes
+   * @param triangle Triangle to rasterize
+   * @param tileX Horizontal position of the top left pixel of the tile
+   * @param tileY Vertical position of the top left pixel of the tile
+   * @param edges Edge functions at the center of the top left pixel
+   * @param bin Bin the tile lies in
+   * @param region Area of the image covered by the bin
+   * @tparam Covered True if the whole tile is inside the triangle and edges do not need to be tested
    */
-  void renderTopTriangle(const Vertex &v0, const Vertex &v1, const Vertex &v2) {
-    for (int y = 0; v0.position.y + y <= v2.position.y; ++y) {
-      float yt = v0.position.y >= v2.position.y ? 0 : y / (v2.position.y - v0.position.y);
-      Vertex a = lerp(v0, v1, yt);
-      Vertex b = lerp(v0, v2, yt);
-      if (a.position.x > b.position.x) swap(a, b);
-      for (int x = 0; a.position.x + x <= b.position.x; ++x) {
-        float xt = a.position.x >= b.position.x ? 0 : x / (b.position.x - a.position.x);
-        Vertex varying = lerp(a, b, xt);
-        setFragment(varying);
+  template<bool Covered>
+  void renderTile(const Triangle &triangle, int tileX, int tileY, const double edges[3], Bin &bin, const Tile &region) {
+    auto &v = triangle.v;
+    auto &b = triangle.b;
+    float a0 = (float) triangle.a[0], a1 = (float) triangle.a[1], a2 = (float) triangle.a[2];
+    // Masks of all set bits for top left edges, so the lanes combine comparisons without branches
+    int left0 = -triangle.topLeft[0], left1 = -triangle.topLeft[1], left2 = -triangle.topLeft[2];
+    float invArea = triangle.invArea;
+    // Limit the tile to the bounding box, small triangles cover few rows and columns of their tiles
+    int firstRow = std::max(0, triangle.minY - tileY), lastRow = std::min(TILE_SIZE - 1, triangle.maxY - tileY);
+    int firstColumn = std::max(0, triangle.minX - tileX), lastColumn = std::min(TILE_SIZE - 1, triangle.maxX - tileX);
+
+    for (int row = firstRow; row <= lastRow; row++) {
+      int y = tileY + row;
+      // Row origins are exact in double, the lane offsets are small multiples of the sub-pixel grid
+      float e0 = (float) (edges[0] + b[0] * row), e1 = (float) (edges[1] + b[1] * row), e2 = (float) (edges[2] + b[2] * row);
+      auto offset = (y - region.y) * BIN_SIZE + tileX - region.x;
+      float *depth = &bin.depth[offset];
+      float w0[TILE_SIZE], w1[TILE_SIZE], w2[TILE_SIZE], z[TILE_SIZE];
+      int pass[TILE_SIZE], passed = 0;
+
+      #pragma omp simd reduction(|:passed)
+      for (int i = 0; i < TILE_SIZE; i++) {
+        w0[i] = e0 + a0 * i;
+        w1[i] = e1 + a1 * i;
+        w2[i] = e2 + a2 * i;
+        int inside = Covered | (((w0[i] > 0) | ((w0[i] == 0) & left0)) &
+                                ((w1[i] > 0) | ((w1[i] == 0) & left1)) &
+                                ((w2[i] > 0) | ((w2[i] == 0) & left2)));
+        // Depth is interpolated linearly in screen space
+        z[i] = (w0[i] * v[0].position.z + w1[i] * v[1].position.z + w2[i] * v[2].position.z) * invArea;
+        pass[i] = inside & (i >= firstColumn) & (i <= lastColumn) & (z[i] <= depth[i]);
+        depth[i] = pass[i] ? z[i] : depth[i];
+        passed |= pass[i];
+      }
+      // Rows hidden behind earlier triangles end here, before the perspective division
+      if (!passed) continue;
+
+      // The other varyings are interpolated by barycentrics divided by w and normalized
+      float inverseW[TILE_SIZE], l0[TILE_SIZE], l1[TILE_SIZE], l2[TILE_SIZE];
+      #pragma omp simd
+      for (int i = 0; i < TILE_SIZE; i++) {
+        l0[i] = w0[i] * v[0].position.w;
+        l1[i] = w1[i] * v[1].position.w;
+        l2[i] = w2[i] * v[2].position.w;
+        float sum = l0[i] + l1[i] + l2[i], normalize = 1.0f / sum;
+        inverseW[i] = sum * invArea;
+        l0[i] *= normalize;
+        l1[i] *= normalize;
+        l2[i] *= normalize;
+      }
+
+      for (int i = firstColumn; i <= lastColumn; i++) {
+        if (!pass[i]) continue;
+        Vertex varying{
+            vec4{tileX + i + .5f, y + .5f, z[i], inverseW[i]},
+            l0[i] * v[0].normal + l1[i] * v[1].normal + l2[i] * v[2].normal,
+            l0[i] * v[0].texCoord + l1[i] * v[1].texCoord + l2[i] * v[2].texCoord,
+            l0[i] * v[0].color + l1[i] * v[1].color + l2[i] * v[2].color
+        };
+        // Compute the fragment color and limit the output
+        vec4 color = clamp(program.fragmentShader(varying), 0.0f, 1.0f);
+        bin.color[offset + i] = {(uint8_t) (color.r * 255.0f), (uint8_t) (color.g * 255.0f), (uint8_t) (color.b * 255.0f)};
       }
     }
   }
 
   /*!
-   * Fill the bottom portion of a triangle that has split horizontally by using interpolation between vertices
-   * @param v0 - First top vertex of the triangle
-   * @param v1 - Second top vertex
-   * @param v2 - Bottom vertex
+   * Rasterize the binned triangles of a bin and copy its pixels to the image
+   * @param region Area of the image covered by the bin
    */
-  void renderBottomTriangle(const Vertex &v0, const Vertex &v1, const Vertex &v2) {
-    for (int y = 0; v0.position.y + y <= v2.position.y; ++y) {
-      float yt =  v0.position.y >= v2.position.y ? 0 : y / (v2.position.y - v0.position.y);
-      Vertex a = lerp(v0, v2, yt);
-      Vertex b = lerp(v1, v2, yt);
-      if (a.position.x > b.position.x) swap(a, b);
-      for (int x = 0; a.position.x + x <= b.position.x; ++x) {
-        float xt = a.position.x >= b.position.x ? 0 : x / (b.position.x - a.position.x);
-        Vertex varying = lerp(a, b, xt);
-        setFragment(varying);
+  void renderBin(const Tile &region) {
+    auto &bin = bins[region.y / BIN_SIZE * binsX + region.x / BIN_SIZE];
+    bool changed = false;
+    for (auto &chunk : bin.triangles) {
+      for (auto index : chunk) {
+        auto &triangle = triangles[index];
+        // Visit the tiles of the bin overlapping the bounding box, tiles are aligned to the image
+        int minX = std::max(triangle.minX, region.x), maxX = std::min(triangle.maxX, region.x + region.width - 1);
+        int minY = std::max(triangle.minY, region.y), maxY = std::min(triangle.maxY, region.y + region.height - 1);
+        for (int tileY = minY / TILE_SIZE * TILE_SIZE; tileY <= maxY; tileY += TILE_SIZE) {
+          for (int tileX = minX / TILE_SIZE * TILE_SIZE; tileX <= maxX; tileX += TILE_SIZE) {
+            double edges[3];
+            bool covered;
+            if (!overlaps(triangle, tileX, tileY, TILE_SIZE, edges, covered))
+              continue;
+            if (covered)
+              renderTile<true>(triangle, tileX, tileY, edges, bin, region);
+            else
+              renderTile<false>(triangle, tileX, tileY, edges, bin, region);
+          }
+        }
+        changed = true;
       }
+      chunk.clear();
     }
+
+    if (!changed) return;
+    auto &framebuffer = image.getFramebuffer();
+    for (int y = 0; y < region.height; y++)
+      copy_n(&bin.color[y * BIN_SIZE], region.width, &framebuffer[(region.y + y) * image.width + region.x]);
   }
 
 public:
@@ -199,7 +346,9 @@ public:
    * @param image Image to render to
    * @param program Program to use for rendering
    */
-  Rasterizer(Image &image, Program &program) : program{program}, image{image} {
+  Rasterizer(Image &image, Program &program) : program{program}, image{image}, scheduler{image.width, image.height, BIN_SIZE} {
+    binsX = (image.width + BIN_SIZE - 1) / BIN_SIZE;
+    bins.resize((size_t) (binsX * ((image.height + BIN_SIZE - 1) / BIN_SIZE)));
     clear();
   };
 
@@ -207,91 +356,96 @@ public:
    * Clear depth buffer and image
    */
   void clear() {
-    // Clear the depth buffer
-    depthBuffer = vector<float>((unsigned long) (image.width * image.height), numeric_limits<float>::max());
-    // Clear the image
-    image.clear({128,128,128});
+    // Clear the image and the memory of the bins
+    Image::Pixel background{128, 128, 128};
+    image.clear(background);
+    for (auto &bin : bins) {
+      bin.color.assign(BIN_SIZE * BIN_SIZE, background);
+      bin.depth.assign(BIN_SIZE * BIN_SIZE, numeric_limits<float>::max());
+      bin.triangles.resize(scheduler.getThreads());
+    }
   }
 
   /*!
-   * Render a face into the image
-   * @param face Face to render
+   * Render the faces of a mesh into the image, faces overlapping each other are drawn in order as if rendered one by one
+   * @param mesh Mesh to render
    */
-  void render(const Face &face) {
-    // transform vertices
-    Vertex t0 = toViewport(program.vertexShader(face.v0));
-    Vertex t1 = toViewport(program.vertexShader(face.v1));
-    Vertex t2 = toViewport(program.vertexShader(face.v2));
-    // Sort the vertices
-    if (t0.position.y > t1.position.y) swap(t0, t1);
-    if (t0.position.y > t2.position.y) swap(t0, t2);
-    if (t1.position.y > t2.position.y) swap(t1, t2);
-    // Split the triangle into top/bottom sections
-    float t = t0.position.y >= t2.position.y ? 0 : (t1.position.y - t0.position.y) / (t2.position.y - t0.position.y);
-    Vertex tm = lerp(t0, t2, t);
-
-    // Render
-    renderTopTriangle(t0, tm, t1);
-    renderBottomTriangle(t1, tm, t2);
+  void render(const IndexedMesh &mesh) {
+    // Every phase runs on the threads of the scheduler
+    // Shade each vertex once, faces are assembled from the transformed vertices
+    auto vertices = mesh.vertices.size();
+    transformed.resize(vertices);
+    scheduler.run((uint32_t) ((vertices + VERTEX_BLOCK - 1) / VERTEX_BLOCK), [&](uint32_t block, unsigned) {
+      auto end = std::min(vertices, (size_t) (block + 1) * VERTEX_BLOCK);
+      for (auto i = (size_t) block * VERTEX_BLOCK; i < end; i++)
+        transformed[i] = toViewport(program.vertexShader(mesh.vertices[i]));
+    });
+
+    auto faces = mesh.indices.size() / 3;
+    triangles.resize(faces);
+
+    // Assemble and bin contiguous chunks of faces in parallel, each chunk appends to its own lists of the bins
+    auto chunks = scheduler.getThreads();
+    scheduler.run(chunks, [&](uint32_t chunk, unsigned) {
+      auto end = faces * (chunk + 1) / chunks;
+      for (auto i = faces * chunk / chunks; i < end; i++) {
+        auto &triangle = triangles[i];
+        triangle = Triangle{{transformed[mesh.indices[3 * i]],
+                             transformed[mesh.indices[3 * i + 1]],
+                             transformed[mesh.indices[3 * i + 2]]}, {}, {}, {}, {}, 0, 0, 0, 0, 0};
+        if (!setup(triangle))
+          continue;
+
+        for (int binY = triangle.minY / BIN_SIZE; binY <= triangle.maxY / BIN_SIZE; binY++) {
+          for (int binX = triangle.minX / BIN_SIZE; binX <= triangle.maxX / BIN_SIZE; binX++) {
+            double edges[3];
+            bool covered;
+            if (overlaps(triangle, binX * BIN_SIZE, binY * BIN_SIZE, BIN_SIZE, edges, covered))
+              bins[binY * binsX + binX].triangles[chunk].push_back((uint32_t) i);
+          }
+        }
+      }
+    });
+
+    // Rasterize the bins in parallel
+    scheduler.run([&](const Tile &region, unsigned) {
+      renderBin(region);
+    });
   }
 };
 
 /*!
- * Load Wavefront obj file data as vector of faces for simplicity
- * @return vector of Faces that can be rendered
+ * Load Wavefront obj file data as an indexed mesh
+ * @return IndexedMesh that can be rendered
  */
-vector<Face> loadObjFile(const string filename) {
+IndexedMesh loadObjFile(const string filename) {
   // Using tiny obj loader from ppgso lib
   vector<tinyobj::shape_t> shapes;
   vector<tinyobj::material_t> materials;
   string err = tinyobj::LoadObj(shapes, materials, filename.c_str());
 
-  // Will only convert 1st shape to Faces
-  auto &mesh = shapes[0].mesh;
-
-  // Collect data in vectors
-  vector<vec4> positions;
-  for (int i = 0; i < (int) mesh.positions.size() / 3; ++i)
-    positions.emplace_back(mesh.positions[3 * i], mesh.positions[3 * i + 1], mesh.positions[3 * i + 2], 1);
-
-  vector<vec4> normals;
-  for (int i = 0; i < (int) mesh.normals.size() / 3; ++i)
-    normals.emplace_back(mesh.normals[3 * i], mesh.normals[3 * i + 1], mesh.normals[3 * i + 2], 1);
-
-  vector<vec2> texcoords;
-  for (int i = 0; i < (int) mesh.texcoords.size() / 2; ++i)
-    texcoords.emplace_back(mesh.texcoords[2 * i], mesh.texcoords[2 * i + 1]);
-
-  // Fill the vector of Faces with data
-  vector<Face> faces(mesh.indices.size() / 3);
-  for (int i = 0; i < (int) faces.size(); i++) {
-    faces[i] = Face{
-        {
-            positions[mesh.indices[i * 3]],
-            normals[mesh.indices[i * 3]],
-            texcoords[mesh.indices[i * 3]],
-            {1, 1, 1, 1}
-        }, {
-            positions[mesh.indices[i * 3 + 1]],
-            normals[mesh.indices[i * 3 + 1]],
-            texcoords[mesh.indices[i * 3 + 1]],
-            {1, 1, 1, 1}
-        }, {
-            positions[mesh.indices[i * 3 + 2]],
-            normals[mesh.indices[i * 3 + 2]],
-            texcoords[mesh.indices[i * 3 + 2]],
-            {1, 1, 1, 1}
-        }
-    };
+  // Will only convert 1st shape to the IndexedMesh
+  auto &shape = shapes[0].mesh;
+
+  // Vertices combine the position, normal and texture coordinates of the same index
+  IndexedMesh mesh;
+  for (size_t i = 0; i < shape.positions.size() / 3; ++i) {
+    Vertex vertex{{shape.positions[3 * i], shape.positions[3 * i + 1], shape.positions[3 * i + 2], 1}, {0, 0, 0, 1}, {0, 0}, {1, 1, 1, 1}};
+    if (3 * i + 2 < shape.normals.size())
+      vertex.normal = {shape.normals[3 * i], shape.normals[3 * i + 1], shape.normals[3 * i + 2], 1};
+    if (2 * i + 1 < shape.texcoords.size())
+      vertex.texCoord = {shape.texcoords[2 * i], shape.texcoords[2 * i + 1]};
+    mesh.vertices.push_back(vertex);
   }
-  return faces;
+  mesh.indices.assign(shape.indices.begin(), shape.indices.end());
+  return mesh;
 };
 
 int main() {
   // Image to store the rendering to
   Image image{512, 512};
-  // Vector of faces loaded from Wavefront obj file
-  auto faces = loadObjFile("corsair.obj");
+  // Mesh loaded from Wavefront obj file
+  auto mesh = loadObjFile("corsair.obj");
   // Image to use as texture in the shader program
   Image texture{image::loadBMP("corsair.bmp")};
   // Shader program to use
@@ -305,8 +459,7 @@ int main() {
   Rasterizer rasterizer{image, program};
 
   // Render all faces
-  for (auto &face : faces)
-    rasterizer.render(face);
+  rasterizer.render(mesh);
 
   // Save the image
   image::saveBMP(image, "test.bmp");